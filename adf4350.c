@@ -27,11 +27,14 @@
 #include <stdbool.h>
 #include <avr/io.h>
 #include <avr/pgmspace.h>
-#include <util/delay.h>
+#include <util/atomic.h>
 
 #include "adf4350.h"
 #include "iopins.h"
 #include "util.h"
+#include "prof.h"
+#include "counters.h"
+#include "trace.h"
 
 /* Specifications */
 #define ADF4350_MAX_OUT_FREQ                    4400000000ULL /* Hz */
@@ -62,9 +65,50 @@ typedef struct
 static uint32_t adf4350_gcd(uint32_t a, uint32_t b);
 static uint32_t adf4350_do_div(uint64_t *n, uint32_t base);
 static int adf4350_tune_r_cnt(adf4350_state_t *st, uint16_t r_cnt);
-static void adf4350_write_reg(uint32_t reg);
+static void adf4350_shift_reg(uint32_t reg);
+static bool adf4350_solve(uint64_t freq, adf4350_platform_data_t *settings, uint32_t *regs);
+static uint64_t adf4350_fpfd(uint32_t clkin, const uint32_t *regs);
 
-bool adf4350_set_freq(uint64_t freq, adf4350_platform_data_t *settings, adf4350_calculated_parameters_t *params)
+static volatile bool _g_adf4350_busy;
+
+adf4350_calculated_parameters_t _g_params;
+
+bool adf4350_set_freq(uint64_t freq, adf4350_platform_data_t *settings)
+{
+    uint32_t regs[ADF4350_NUM_REGS];
+    bool ret;
+
+    PROF_BEGIN(PROF_SET_FREQ_CALC);
+    ret = adf4350_calc_freq(freq, settings, regs);
+    PROF_END(PROF_SET_FREQ_CALC);
+
+    if (!ret)
+        return false;
+
+    PROF_BEGIN(PROF_SET_FREQ_WRITE);
+    adf4350_write_regs(regs);
+    PROF_END(PROF_SET_FREQ_WRITE);
+
+    return true;
+}
+
+/*
+ * Solves for freq and fills in regs without touching the hardware.
+ */
+bool adf4350_calc_freq(uint64_t freq, adf4350_platform_data_t *settings, uint32_t *regs)
+{
+    bool ret;
+
+    _g_counters.stats.solves++;
+
+    TRACE(TRACE_SOLVE_START, 0);
+    ret = adf4350_solve(freq, settings, regs);
+    TRACE(TRACE_SOLVE_END, ret);
+
+    return ret;
+}
+
+static bool adf4350_solve(uint64_t freq, adf4350_platform_data_t *settings, uint32_t *regs)
 {
     adf4350_state_t st;
     uint32_t chspc;
@@ -74,7 +118,6 @@ bool adf4350_set_freq(uint64_t freq, adf4350_platform_data_t *settings, adf4350_
     uint16_t mdiv;
     uint16_t r_cnt = 0;
     uint8_t band_sel_div;
-    uint32_t regs[6];
 
     memset(&st, 0x00, sizeof(adf4350_state_t));
 
@@ -148,14 +191,6 @@ bool adf4350_set_freq(uint64_t freq, adf4350_platform_data_t *settings, adf4350_
             ADF4350_REG2_CHARGE_PUMP_CURR_uA(5000) |
             ADF4350_REG2_MUXOUT(0x7UL) | ADF4350_REG2_NOISE_MODE(0x3UL))) | ADF4350_REG2;
 
-    regs[ADF4350_REG3] = (settings->r3_user_settings &
-        (ADF4350_REG3_12BIT_CLKDIV(0xFFF) |
-            ADF4350_REG3_12BIT_CLKDIV_MODE(0x3UL) |
-            ADF4350_REG3_12BIT_CSR_EN |
-            ADF4351_REG3_CHARGE_CANCELLATION_EN |
-            ADF4351_REG3_ANTI_BACKLASH_3ns_EN |
-            ADF4351_REG3_BAND_SEL_CLOCK_MODE_HIGH)) | ADF4350_REG3;
-
     regs[ADF4350_REG4] =
         ADF4350_REG4_FEEDBACK_FUND |
         ADF4350_REG4_RF_DIV_SEL(st.r4_rf_div_sel) |
@@ -168,35 +203,121 @@ bool adf4350_set_freq(uint64_t freq, adf4350_platform_data_t *settings, adf4350_
             ADF4350_REG4_AUX_OUTPUT_FUND |
             ADF4350_REG4_MUTE_TILL_LOCK_EN)) | ADF4350_REG4;
 
+    adf4350_fixed_regs(settings, regs);
+
+    return true;
+}
+
+/*
+ * R3 and R5 only depend on the platform settings, never on frequency.
+ */
+void adf4350_fixed_regs(adf4350_platform_data_t *settings, uint32_t *regs)
+{
+    regs[ADF4350_REG3] = (settings->r3_user_settings &
+        (ADF4350_REG3_12BIT_CLKDIV(0xFFF) |
+            ADF4350_REG3_12BIT_CLKDIV_MODE(0x3UL) |
+            ADF4350_REG3_12BIT_CSR_EN |
+            ADF4351_REG3_CHARGE_CANCELLATION_EN |
+            ADF4351_REG3_ANTI_BACKLASH_3ns_EN |
+            ADF4351_REG3_BAND_SEL_CLOCK_MODE_HIGH)) | ADF4350_REG3;
+
     regs[ADF4350_REG5] = ADF4350_REG5_LD_PIN_MODE_DIGITAL | 0x180000 /* Reserved bits */ | ADF4350_REG5;
+}
+
+/*
+ * PFD in Hz, as decoded from R2. Zero if R2 holds no valid R count.
+ */
+uint64_t adf4350_pfd(uint32_t clkin, const uint32_t *regs)
+{
+    return adf4350_fpfd(clkin, regs) / 1000;
+}
+
+/*
+ * VCO in Hz from INT, FRACT and MOD. Kept in 1000th's of a Hz until the
+ * end to match the resolution the solver works at.
+ */
+uint64_t adf4350_vco(uint32_t clkin, const uint32_t *regs)
+{
+    uint16_t mod = adf4350_mod(regs);
 
-    if (params)
+    if (!mod)
+        return 0;
+
+    return ((((uint64_t)adf4350_intv(regs) * 1000000) + (((uint64_t)adf4350_fract(regs) * 1000000)
+        / mod)) * adf4350_fpfd(clkin, regs)) / 1000000 / 1000;
+}
+
+uint64_t adf4350_actual_freq(uint32_t clkin, const uint32_t *regs)
+{
+    return adf4350_vco(clkin, regs) >> adf4350_rf_div_sel(regs);
+}
+
+/*
+ * The busy flag keeps the retune ISR off the bus, and _g_params in step
+ * with the part, until the shadow copy has been updated as well.
+ */
+void adf4350_write_regs(const uint32_t *regs)
+{
+    _g_adf4350_busy = true;
+
+    for (int i = 6; i > 0; i--) // Mandatory to write registers in reverse order
+        adf4350_shift_reg(regs[i - 1]);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
     {
-        params->vco = freq;
-        params->pfd = st.fpfd;
-        params->r_cnt = r_cnt;
-        params->intv = st.r0_int;
-        params->fract = st.r0_fract;
-        params->mod = st.r1_mod;
-        params->rf_div = (1 << st.r4_rf_div_sel);
-        params->actual_freq = (((((uint64_t)st.r0_int * 1000000) + (((uint64_t)st.r0_fract * 1000000)
-            / ((uint64_t)st.r1_mod))) * st.fpfd) / (1 << st.r4_rf_div_sel)) / 1000000;
-        params->prescaler = prescaler;
-        params->band_sel_div = band_sel_div;
-        // Originally kept in 1000th's of a Hz to improve the resolution of the calculation of actual_freq
-        params->actual_freq /= 1000;
-        params->pfd /= 1000;
-
-        for (int i = 0; i < 6; i++)
-            params->regs[i] = regs[i];
+        memcpy(_g_params.regs, regs, sizeof(_g_params.regs));
     }
 
-    for (int i = 6; i > 0; i--) // Mandatory to write registers in reverse order
-        adf4350_write_reg(regs[i - 1]);
+    _g_adf4350_busy = false;
+}
+
+/*
+ * For use from interrupt context. Fails if the main context is part way
+ * through a write, in which case the caller should try again later. Only
+ * words that differ from the part are shifted out, plus R0 which
+ * triggers the update, so a typical hop is two words.
+ */
+bool adf4350_write_regs_isr(const uint32_t *regs)
+{
+    if (_g_adf4350_busy)
+        return false;
+
+    for (int i = 5; i > 0; i--)
+    {
+        if (regs[i] != _g_params.regs[i])
+            adf4350_shift_reg(regs[i]);
+    }
+
+    adf4350_shift_reg(regs[ADF4350_REG0]);
+    memcpy(_g_params.regs, regs, sizeof(_g_params.regs));
 
     return true;
 }
 
+void adf4350_write_reg(uint32_t reg)
+{
+    _g_adf4350_busy = true;
+    adf4350_shift_reg(reg);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        _g_params.regs[ADF4350_REG_ADDR(reg)] = reg;
+    }
+
+    _g_adf4350_busy = false;
+}
+
+/*
+ * Snapshot of _g_params.regs, which the retune ISR may change at any time.
+ */
+void adf4350_get_regs(uint32_t *regs)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memcpy(regs, _g_params.regs, sizeof(_g_params.regs));
+    }
+}
+
 static int adf4350_tune_r_cnt(adf4350_state_t *st, uint16_t r_cnt)
 {
     adf4350_platform_data_t *pdata = st->pdata;
@@ -209,6 +330,20 @@ static int adf4350_tune_r_cnt(adf4350_state_t *st, uint16_t r_cnt)
     return r_cnt;
 }
 
+/*
+ * PFD in 1000th's of a Hz, as the solver works.
+ */
+static uint64_t adf4350_fpfd(uint32_t clkin, const uint32_t *regs)
+{
+    uint32_t r2 = regs[ADF4350_REG2];
+    uint16_t r_cnt = adf4350_r_cnt(regs);
+
+    if (!r_cnt)
+        return 0;
+
+    return (((uint64_t)clkin * 1000) * (r2 & ADF4350_REG2_RMULT2_EN ? 2 : 1)) / (r_cnt * (r2 & ADF4350_REG2_RDIV2_EN ? 2 : 1));
+}
+
 static uint32_t adf4350_do_div(uint64_t *n, uint32_t base)
 {
     uint32_t remainder = *n % base;
@@ -253,27 +388,38 @@ static uint32_t adf4350_gcd(uint32_t a, uint32_t b)
     }
 }
 
-static void adf4350_write_reg(uint32_t reg)
+/*
+ * No delays needed. At 20 MHz every port write is 50 ns apart, above
+ * the ADF4350's 10-25 ns setup, hold and pulse width minimums.
+ */
+static void adf4350_shift_reg(uint32_t reg)
 {
+    uint32_t bits = reg;
+
+    PROF_BEGIN(PROF_REG_WORD);
+    TRACE(TRACE_REG_WRITE, ADF4350_REG_ADDR(reg));
+
     IO_LOW(LE);
-    _delay_us(1);
 
     for (int i = 0; i < 32; i++)
     {
-        if (reg & 0x80000000)
+        if (bits & 0x80000000)
             IO_HIGH(DATA);
         else
             IO_LOW(DATA);
 
-        _delay_us(1);
-        reg <<= 1;
+        bits <<= 1;
         IO_HIGH(CLOCK);
-        _delay_us(1);
         IO_LOW(CLOCK);
-        _delay_us(1);
     }
 
-    _delay_us(1);
     IO_HIGH(LE);
-    _delay_us(10);
+    TRACE(TRACE_LE_LATCH, ADF4350_REG_ADDR(reg));
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        _g_counters.stats.reg_words++; /* Also written from the retune ISR */
+    }
+
+    PROF_END(PROF_REG_WORD);
 }
@@ -28,6 +28,8 @@
 #define ADF4350_REG3                            3
 #define ADF4350_REG4                            4
 #define ADF4350_REG5                            5
+#define ADF4350_NUM_REGS                        6
+#define ADF4350_REG_ADDR(x)                     ((x) & 0x7) /* Control bits */
 
 /* REG0 Bit Definitions */
 #define ADF4350_REG0_FRACT(x)                   ((((uint32_t)x) & 0xFFF) << 3)
@@ -114,21 +116,37 @@ typedef struct
 	uint32_t        r4_user_settings;
 } adf4350_platform_data_t;
 
+/*
+ * Everything else about a solution (INT, FRACT, MOD, R, dividers and the
+ * resulting frequencies) is decoded from the registers on demand.
+ */
 typedef struct
 {
-    uint64_t vco;
-    uint64_t pfd;
-    uint16_t r_cnt;
-    uint16_t intv;
-    uint16_t fract;
-    uint16_t mod;
-    uint16_t rf_div;
-    uint64_t actual_freq;
-    bool prescaler;
-    uint16_t band_sel_div;
-    uint32_t regs[6];
+    uint32_t regs[ADF4350_NUM_REGS];
 } adf4350_calculated_parameters_t;
 
-bool adf4350_set_freq(uint64_t freq, adf4350_platform_data_t *settings, adf4350_calculated_parameters_t *params);
+/* Register field decode */
+#define adf4350_intv(regs)                      ((uint16_t)((regs)[ADF4350_REG0] >> 15))
+#define adf4350_fract(regs)                     ((uint16_t)((regs)[ADF4350_REG0] >> 3) & 0xFFF)
+#define adf4350_mod(regs)                       ((uint16_t)((regs)[ADF4350_REG1] >> 3) & 0xFFF)
+#define adf4350_prescaler(regs)                 (((regs)[ADF4350_REG1] & ADF4350_REG1_PRESCALER) != 0)
+#define adf4350_r_cnt(regs)                     ((uint16_t)((regs)[ADF4350_REG2] >> 14) & 0x3FF)
+#define adf4350_band_sel_div(regs)              ((uint8_t)((regs)[ADF4350_REG4] >> 12))
+#define adf4350_rf_div_sel(regs)                ((uint8_t)((regs)[ADF4350_REG4] >> 20) & 0x7)
+#define adf4350_rf_div(regs)                    (1 << adf4350_rf_div_sel(regs))
+
+bool adf4350_set_freq(uint64_t freq, adf4350_platform_data_t *settings);
+bool adf4350_calc_freq(uint64_t freq, adf4350_platform_data_t *settings, uint32_t *regs);
+void adf4350_fixed_regs(adf4350_platform_data_t *settings, uint32_t *regs);
+void adf4350_write_regs(const uint32_t *regs);
+bool adf4350_write_regs_isr(const uint32_t *regs);
+void adf4350_write_reg(uint32_t reg);
+void adf4350_get_regs(uint32_t *regs);
+uint64_t adf4350_pfd(uint32_t clkin, const uint32_t *regs);
+uint64_t adf4350_vco(uint32_t clkin, const uint32_t *regs);
+uint64_t adf4350_actual_freq(uint32_t clkin, const uint32_t *regs);
+
+/* Registers last written to the part, updated by the write functions */
+extern adf4350_calculated_parameters_t _g_params;
 
 #endif /* __ADF4350_H__ */
\ No newline at end of file
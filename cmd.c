@@ -23,6 +23,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <avr/io.h>
 #include <avr/pgmspace.h>
 #include <util/delay.h>
 
@@ -32,6 +33,16 @@
 #include "usart.h"
 #include "util.h"
 #include "adf4350.h"
+#include "proto.h"
+#include "timer.h"
+#include "counters.h"
+#include "retune.h"
+#include "seq.h"
+#include "task.h"
+#include "prof.h"
+#include "latency.h"
+#include "trace.h"
+#include "isrstat.h"
 
 #define CMD_NONE              0x00
 #define CMD_READLINE          0x01
@@ -43,6 +54,8 @@
 #define CMD_DEL               0x07
 #define CMD_DROP_NAV          0x08
 #define CMD_CANCEL            0x10
+#define CMD_BINARY            0x11
+#define CMD_BINARY_COMPLETE   0x12
 
 #define CTL_CANCEL            0x03
 #define CTL_XOFF              0x13
@@ -60,32 +73,113 @@
 #define SEQ_PGDN              0x36
 #define SEQ_NAV_END           0x7E
 
-#define PARAM_U8              0
-#define PARAM_U16             1
-#define PARAM_U64             2
-#define PARAM_U64_3DP         3
+#define PARAM_U16             0
+#define PARAM_FREQ            1
 
+#define ARG_NONE              0
+#define ARG_OPTIONAL          1
+#define ARG_REQUIRED          2
+
+#define CMD_MAX_NAME          8
+
+#ifdef _USART1_
+#define CMD_MAX_CONSOLE       2
+#else
 #define CMD_MAX_CONSOLE       1
-#define CMD_MAX_HISTORY       4
+#endif
+#define CMD_HISTORY_SIZE      80   /* Bytes of packed history per console */
 
 typedef struct
 {
     char cmd_buf[CMD_MAX_LINE];
-    char cmd_history[CMD_MAX_HISTORY][CMD_MAX_LINE];
-    uint8_t next_history;
-    uint8_t show_history;
-    uint8_t max_history;
+    uint8_t history[CMD_HISTORY_SIZE]; /* [len][text] entries, oldest first */
+    uint8_t history_used;
+    uint8_t history_count;
+    uint8_t show_history;              /* 0 = not browsing, n = nth newest */
     int8_t count;
     uint8_t state;
     uint8_t ignore_lf;
+    int32_t frame_tick;
+    uint16_t stream_period;
+    int8_t stream_task;
+    bool stream_binary;
+    bool save_pending;                 /* Report when the EEPROM write completes */
 } cmd_state_t;
 
-static void do_help(void);
+typedef struct
+{
+    const char *s;
+    uint8_t len;
+} cmd_slice_t;
+
+typedef bool (*cmd_handler_t)(sys_config_t *config, const char *arg);
+
+typedef struct
+{
+    char name[CMD_MAX_NAME];
+    cmd_handler_t handler;
+    uint8_t arg;
+    const char *args;
+    const char *help;
+} cmd_desc_t;
+
 static void cmd_prompt(cmd_state_t *ccmd);
+static bool cmd_dispatch(const char *text, sys_config_t *config);
+static const cmd_desc_t *cmd_lookup(const cmd_slice_t *name);
+static bool cmd_next_token(const char **p, cmd_slice_t *tok);
+static uint8_t *cmd_history_entry(cmd_state_t *ccmd, uint8_t n);
+static void cmd_history_remove(cmd_state_t *ccmd, uint8_t *entry);
+static void cmd_history_add(cmd_state_t *ccmd);
+static void cmd_history_show(cmd_state_t *ccmd);
+static bool do_help(sys_config_t *config, const char *arg);
+static bool do_show(sys_config_t *config, const char *arg);
 static bool do_power(sys_config_t *config, const char *arg);
 static bool do_on_off(sys_config_t *config, const char *arg);
+static bool do_set_freq(sys_config_t *config, const char *arg);
+static bool do_r(sys_config_t *config, const char *arg);
+static bool do_save(sys_config_t *config, const char *arg);
+static bool do_default(sys_config_t *config, const char *arg);
+static bool do_reset(sys_config_t *config, const char *arg);
+static bool do_dump_state(sys_config_t *config, const char *arg);
+static bool do_query_freq(sys_config_t *config, const char *arg);
+static bool do_query_lock(sys_config_t *config, const char *arg);
+static bool do_query_regs(sys_config_t *config, const char *arg);
+static bool do_stream(sys_config_t *config, const char *arg);
+static bool do_reg_write(sys_config_t *config, const char *arg);
+static bool do_at(sys_config_t *config, const char *arg);
+static bool do_query_tick(sys_config_t *config, const char *arg);
+static bool do_regs_write(sys_config_t *config, const char *arg);
+static bool do_seq(sys_config_t *config, const char *arg);
+static bool do_autorun(sys_config_t *config, const char *arg);
+static bool do_store(sys_config_t *config, const char *arg);
+static bool do_recall(sys_config_t *config, const char *arg);
+static bool do_presets(sys_config_t *config, const char *arg);
+static bool do_tasks(sys_config_t *config, const char *arg);
+static bool do_stats(sys_config_t *config, const char *arg);
+static bool do_latency(sys_config_t *config, const char *arg);
+static bool do_mem(sys_config_t *config, const char *arg);
+#ifdef _ISR_STATS_
+static bool do_isr(sys_config_t *config, const char *arg);
+#endif
+#ifdef _RTC_CALIBRATION_
+static bool do_cal(sys_config_t *config, const char *arg);
+#endif
+#ifdef _PROFILE_
+static bool do_perf(sys_config_t *config, const char *arg);
+#endif
+#ifdef _TRACE_
+static bool do_trace(sys_config_t *config, const char *arg);
+#endif
+static void cmd_stream_task(sys_config_t *config, uint8_t idx);
+static void cmd_stream_stop(cmd_state_t *ccmd);
+static bool cmd_data_ready(uint8_t idx);
+static char cmd_get(uint8_t idx);
 static void cmd_erase_line(cmd_state_t *ccmd);
-static bool parse_param(void *param, uint8_t type, char *arg);
+static bool parse_param(void *param, uint8_t type, const char *arg);
+static bool parse_u16(const char *s, uint8_t len, uint16_t *value);
+static bool parse_u32(const char *s, uint8_t len, uint32_t *value);
+static bool parse_freq(const char *s, uint8_t len, uint64_t *hz);
+static bool parse_hex32(const char *s, uint8_t len, uint32_t *value);
 
 uint8_t _g_current_console;
 cmd_state_t _g_cmd[CMD_MAX_CONSOLE];
@@ -98,128 +192,822 @@ static const char *_g_powerLevels[] =
     "+5"
 };
 
-static void do_help(void)
-{
-    printf(
-        "\r\nCommands:\r\n\r\n"
-        "\tfreq [nnnn.nnn]\r\n"
-        "\t\tSet output frequency in MHz\r\n\r\n"
-        "\tr [r]\r\n"
-        "\t\tSet maximum R value\r\n\r\n"
-        "\tpower [-4|-1|+2|+5]\r\n"
-        "\t\tSet output power in dBm\r\n\r\n"
-        "\tout [on|off]\r\n"
-        "\t\tSet output on or off\r\n\r\n"
-        "\tshow\r\n"
-        "\t\tShow current configuration\r\n\r\n"
-        "\tdefault\r\n"
-        "\t\tLoad the default configuration\r\n\r\n"
-        "\tsave\r\n"
-        "\t\tSave current configuration\r\n\r\n"
-        "\tstate\r\n"
-        "\t\tDump switch state / average / last sent values\r\n\r\n"
-    );
-}
-
-static void do_show(sys_config_t *config)
-{
-    uint32_t set_freq = (uint32_t)(config->freq / 1000);
-    uint32_t set_freq_rem = (uint32_t)(config->freq % 1000);
-
-    printf(
-            "\r\nCurrent configuration:\r\n\r\n"
-            "\tfreq ..............: %lu.%lu MHz\r\n"
-            "\tr .................: %u\r\n"
-            "\tpower .............: %s dBm\r\n"
-            "\tout ...............: %s\r\n"
-            "\r\n",
-            set_freq,
-            set_freq_rem,
-            config->r_value,
-            _g_powerLevels[config->power],
-            config->out_on ? "on" : "off"
-    );
-}
-
-bool command_prompt_handler(char *text, sys_config_t *config)
-{
-    char *command;
-    char *arg;
-
-    command = strtok(text, " ");
-    arg = strtok(NULL, "");
-
-    if (!stricmp(command, "state"))
-    {
-        do_state();
+static const char _g_args_at[] PROGMEM = "[[+]tick freq [f]|regs [r0] .. [r5]|clear]";
+static const char _g_help_at[] PROGMEM = "Queue a pre-solved retune for an absolute (or +relative) tick, no args lists";
+static const char _g_args_autorun[] PROGMEM = "[on|off]";
+static const char _g_help_autorun[] PROGMEM = "Start the saved sequence at power on";
+#ifdef _RTC_CALIBRATION_
+static const char _g_help_cal[] PROGMEM = "Show main clock error measured against the 32.768 kHz reference";
+#endif
+static const char _g_help_default[] PROGMEM = "Load the default configuration";
+static const char _g_args_freq[] PROGMEM = "[nnnn.nnnnnn][Hz|kHz|MHz|GHz]";
+static const char _g_help_freq[] PROGMEM = "Set output frequency (MHz if no unit given)";
+#ifdef _ISR_STATS_
+static const char _g_args_isr[] PROGMEM = "[reset]";
+static const char _g_help_isr[] PROGMEM = "Max duration of each interrupt, and TCB0 latency, in cycles";
+#endif
+static const char _g_args_latency[] PROGMEM = "[reset]";
+static const char _g_help_latency[] PROGMEM = "Histogram of idle loop gaps and the worst stall's cause";
+static const char _g_help_mem[] PROGMEM = "SRAM use and stack high water mark, in bytes";
+static const char _g_args_out[] PROGMEM = "[on|off]";
+static const char _g_help_out[] PROGMEM = "Set output on or off";
+static const char _g_args_power[] PROGMEM = "[-4|-1|+2|+5]";
+static const char _g_help_power[] PROGMEM = "Set output power in dBm";
+#ifdef _PROFILE_
+static const char _g_help_perf[] PROGMEM = "Dump and reset profiling counters (cycles)";
+#endif
+static const char _g_help_presets[] PROGMEM = "List stored presets";
+static const char _g_args_r[] PROGMEM = "[r]";
+static const char _g_help_r[] PROGMEM = "Set maximum R value";
+static const char _g_args_recall[] PROGMEM = "[n]";
+static const char _g_help_recall[] PROGMEM = "Recall preset n (no re-solve)";
+static const char _g_args_reg[] PROGMEM = "[n] [hex]";
+static const char _g_help_reg[] PROGMEM = "Write a raw word to register n";
+static const char _g_args_regs[] PROGMEM = "[r0] .. [r5]";
+static const char _g_help_regs[] PROGMEM = "Write all six raw register words (hex), R5 first";
+static const char _g_help_save[] PROGMEM = "Save current configuration";
+static const char _g_args_seq[] PROGMEM = "[add f|sweep f step n|dwell ms|run|stop|clear|save|load]";
+static const char _g_help_seq[] PROGMEM = "Edit or run the hop list / sweep, no args lists";
+static const char _g_help_show[] PROGMEM = "Show current configuration";
+static const char _g_args_store[] PROGMEM = "[n]";
+static const char _g_help_store[] PROGMEM = "Store current configuration and its registers as preset n";
+static const char _g_args_stream[] PROGMEM = "[ms]";
+static const char _g_help_stream[] PROGMEM = "Print '$tick,lock,index,unlocks,uart_errors,failures,solves' every ms (0 or any key stops)";
+static const char _g_help_tasks[] PROGMEM = "List scheduled tasks with run time and overrun counts";
+static const char _g_task_stream[] PROGMEM = "stream";
+static const char _g_args_stats[] PROGMEM = "[reset]";
+static const char _g_help_stats[] PROGMEM = "Show runtime statistics, optionally clearing them";
+#ifdef _TRACE_
+static const char _g_args_trace[] PROGMEM = "[clear]";
+static const char _g_help_trace[] PROGMEM = "Dump the event trace, oldest first, optionally clearing it";
+#endif
+static const char _g_help_state[] PROGMEM = "Dump calculated state and register values";
+static const char _g_help_qfreq[] PROGMEM = "Print actual frequency in Hz";
+static const char _g_help_qlock[] PROGMEM = "Print lock detect state (1 = locked)";
+static const char _g_help_qregs[] PROGMEM = "Print R0..R5 in hex";
+static const char _g_help_qtick[] PROGMEM = "Print current tick (ms)";
+
+/*
+ * Command table. Looked up by binary search, so entries MUST be kept
+ * in case-insensitive alphabetical order. Entries without help text
+ * are not listed by 'help'.
+ */
+static const cmd_desc_t _g_commands[] PROGMEM =
+{
+    { "?",       do_help,       ARG_NONE,     NULL,             NULL             },
+    { "?freq",   do_query_freq, ARG_NONE,     NULL,             _g_help_qfreq    },
+    { "?lock",   do_query_lock, ARG_NONE,     NULL,             _g_help_qlock    },
+    { "?regs",   do_query_regs, ARG_NONE,     NULL,             _g_help_qregs    },
+    { "?tick",   do_query_tick, ARG_NONE,     NULL,             _g_help_qtick    },
+    { "at",      do_at,         ARG_OPTIONAL, _g_args_at,       _g_help_at       },
+    { "autorun", do_autorun,    ARG_REQUIRED, _g_args_autorun,  _g_help_autorun  },
+#ifdef _RTC_CALIBRATION_
+    { "cal",     do_cal,        ARG_NONE,     NULL,             _g_help_cal      },
+#endif
+    { "default", do_default,    ARG_NONE,     NULL,             _g_help_default  },
+    { "freq",    do_set_freq,   ARG_REQUIRED, _g_args_freq,     _g_help_freq     },
+    { "help",    do_help,       ARG_NONE,     NULL,             NULL             },
+#ifdef _ISR_STATS_
+    { "isr",     do_isr,        ARG_OPTIONAL, _g_args_isr,      _g_help_isr      },
+#endif
+    { "latency", do_latency,    ARG_OPTIONAL, _g_args_latency,  _g_help_latency  },
+    { "mem",     do_mem,        ARG_NONE,     NULL,             _g_help_mem      },
+    { "out",     do_on_off,     ARG_REQUIRED, _g_args_out,      _g_help_out      },
+#ifdef _PROFILE_
+    { "perf",    do_perf,       ARG_NONE,     NULL,             _g_help_perf     },
+#endif
+    { "power",   do_power,      ARG_REQUIRED, _g_args_power,    _g_help_power    },
+    { "presets", do_presets,    ARG_NONE,     NULL,             _g_help_presets  },
+    { "r",       do_r,          ARG_REQUIRED, _g_args_r,        _g_help_r        },
+    { "recall",  do_recall,     ARG_REQUIRED, _g_args_recall,   _g_help_recall   },
+    { "reg",     do_reg_write,  ARG_REQUIRED, _g_args_reg,      _g_help_reg      },
+    { "regs",    do_regs_write, ARG_REQUIRED, _g_args_regs,     _g_help_regs     },
+    { "reset",   do_reset,      ARG_NONE,     NULL,             NULL             },
+    { "save",    do_save,       ARG_NONE,     NULL,             _g_help_save     },
+    { "seq",     do_seq,        ARG_OPTIONAL, _g_args_seq,      _g_help_seq      },
+    { "show",    do_show,       ARG_NONE,     NULL,             _g_help_show     },
+    { "state",   do_dump_state, ARG_NONE,     NULL,             _g_help_state    },
+    { "stats",   do_stats,      ARG_OPTIONAL, _g_args_stats,    _g_help_stats    },
+    { "store",   do_store,      ARG_REQUIRED, _g_args_store,    _g_help_store    },
+    { "stream",  do_stream,     ARG_REQUIRED, _g_args_stream,   _g_help_stream   },
+    { "tasks",   do_tasks,      ARG_NONE,     NULL,             _g_help_tasks    },
+#ifdef _TRACE_
+    { "trace",   do_trace,      ARG_OPTIONAL, _g_args_trace,    _g_help_trace    },
+#endif
+};
+
+#define CMD_COUNT (sizeof(_g_commands) / sizeof(_g_commands[0]))
+
+static bool do_help(sys_config_t *config, const char *arg)
+{
+    uint8_t i;
+
+    printf("\r\nCommands:\r\n\r\n");
+
+    for (i = 0; i < CMD_COUNT; i++)
+    {
+        const char *args = pgm_read_ptr(&_g_commands[i].args);
+        const char *help = pgm_read_ptr(&_g_commands[i].help);
+
+        if (!help)
+            continue;
+
+        printf("\t%S", _g_commands[i].name);
+
+        if (args)
+            printf(" %S", args);
+
+        printf("\r\n\t\t%S\r\n\r\n", help);
+    }
+
+    return true;
+}
+
+static bool do_show(sys_config_t *config, const char *arg)
+{
+    print_p("\r\nCurrent configuration:\r\n\r\n\tfreq ..............: ");
+    print_u64_dp(config->freq, 6);
+    print_p(" MHz\r\n\tr .................: ");
+    print_u32(config->r_value);
+    print_p("\r\n\tpower .............: ");
+    print_str(_g_powerLevels[config->power]);
+    print_p(" dBm\r\n\tout ...............: ");
+    print_pstr(config->out_on ? PSTR("on") : PSTR("off"));
+    print_p("\r\n\tautorun ...........: ");
+    print_pstr(config->autorun ? PSTR("on") : PSTR("off"));
+    print_p("\r\n\r\n");
+
+    return true;
+}
+
+static const cmd_desc_t *cmd_lookup(const cmd_slice_t *name)
+{
+    uint8_t lo = 0;
+    uint8_t hi = CMD_COUNT;
+
+    if (name->len >= CMD_MAX_NAME)
+        return NULL;
+
+    while (lo < hi)
+    {
+        uint8_t mid = (lo + hi) >> 1;
+        int ret = strncasecmp_P(name->s, _g_commands[mid].name, name->len);
+
+        if (!ret && pgm_read_byte(&_g_commands[mid].name[name->len]))
+            ret = -1; /* Table entry is longer */
+
+        if (!ret)
+            return &_g_commands[mid];
+
+        if (ret < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return NULL;
+}
+
+/*
+ * Run at start up. Reports any entry which doesn't sort after the one
+ * before it, as cmd_lookup() would silently miss it or its neighbours.
+ */
+bool cmd_table_check(void)
+{
+    char prev[CMD_MAX_NAME];
+    bool ret = true;
+    uint8_t i;
+
+    for (i = 1; i < CMD_COUNT; i++)
+    {
+        strncpy_P(prev, _g_commands[i - 1].name, sizeof(prev));
+
+        if (strcasecmp_P(prev, _g_commands[i].name) >= 0)
+        {
+            printf("Error: Command table out of order at '%S'\r\n", _g_commands[i].name);
+            ret = false;
+        }
+    }
+
+    return ret;
+}
+
+/*
+ * Non-destructive tokenizer. Skips leading spaces, returns the next
+ * space delimited token as a slice of the line and advances *p past it.
+ */
+static bool cmd_next_token(const char **p, cmd_slice_t *tok)
+{
+    const char *s = *p;
+
+    while (*s == ' ')
+        s++;
+
+    tok->s = s;
+
+    while (*s && *s != ' ')
+        s++;
+
+    tok->len = s - tok->s;
+    *p = s;
+
+    return tok->len != 0;
+}
+
+bool command_prompt_handler(const char *text, sys_config_t *config)
+{
+    uint32_t start = now_us();
+    bool ret;
+
+    TRACE(TRACE_CMD, _g_current_console);
+
+    PROF_BEGIN(PROF_COMMAND);
+    ret = cmd_dispatch(text, config);
+    PROF_END(PROF_COMMAND);
+
+    latency_note(text, false, now_us() - start);
+
+    _g_counters.stats.commands++;
+
+    if (!ret)
+        _g_counters.stats.command_failures++;
+
+    return ret;
+}
+
+static bool cmd_dispatch(const char *text, sys_config_t *config)
+{
+    const cmd_desc_t *desc;
+    cmd_handler_t handler;
+    cmd_slice_t command;
+    const char *arg = text;
+
+    if (!cmd_next_token(&arg, &command))
         return true;
+
+    while (*arg == ' ')
+        arg++;
+
+    desc = cmd_lookup(&command);
+
+    if (!desc)
+    {
+        printf("Error: No such command (%.*s)\r\n", command.len, command.s);
+        return false;
     }
-    else if (!stricmp(command, "freq"))
+
+    if (pgm_read_byte(&desc->arg) == ARG_REQUIRED && !*arg)
     {
-        bool ret = parse_param(&config->freq, PARAM_U64_3DP, arg);
+        printf("Error: Missing parameter\r\n");
+        return false;
+    }
 
-        if (ret)
-            return do_freq(config);
+    handler = (cmd_handler_t)pgm_read_ptr(&desc->handler);
 
+    return handler(config, arg);
+}
+
+static bool do_set_freq(sys_config_t *config, const char *arg)
+{
+    if (!parse_param(&config->freq, PARAM_FREQ, arg))
         return false;
+
+    return do_freq(config);
+}
+
+static bool do_r(sys_config_t *config, const char *arg)
+{
+    return parse_param(&config->r_value, PARAM_U16, arg);
+}
+
+static bool do_save(sys_config_t *config, const char *arg)
+{
+    uint32_t regs[ADF4350_NUM_REGS];
+
+    do_save_config(config, do_solve(config, config->freq, regs) ? regs : NULL);
+
+    _g_cmd[_g_current_console].save_pending = true;
+    return true;
+}
+
+static bool do_default(sys_config_t *config, const char *arg)
+{
+    default_configuration(config);
+    printf("\r\nDefault configuration loaded.\r\n\r\n");
+    return true;
+}
+
+static bool do_reset(sys_config_t *config, const char *arg)
+{
+    printf("\r\n");
+    while (console_busy());
+#ifdef _USART1_
+    while (console2_busy());
+#endif
+    reset();
+    return true;
+}
+
+static bool do_dump_state(sys_config_t *config, const char *arg)
+{
+    do_state();
+    return true;
+}
+
+static bool do_query_freq(sys_config_t *config, const char *arg)
+{
+    print_u64_dp(do_actual_freq(), 0);
+    print_p("\r\n");
+    return true;
+}
+
+static bool do_query_lock(sys_config_t *config, const char *arg)
+{
+    putch(IO_IN_HIGH(LD) ? '1' : '0');
+    print_p("\r\n");
+    return true;
+}
+
+static bool do_query_regs(sys_config_t *config, const char *arg)
+{
+    uint32_t regs[ADF4350_NUM_REGS];
+    uint8_t i;
+
+    adf4350_get_regs(regs);
+
+    for (i = 0; i < 6; i++)
+    {
+        if (i)
+            putch(' ');
+        print_hex32(regs[i]);
     }
-    else if (!stricmp(command, "r"))
+
+    print_p("\r\n");
+    return true;
+}
+
+static bool do_stream(sys_config_t *config, const char *arg)
+{
+    uint16_t period;
+
+    if (!parse_param(&period, PARAM_U16, arg))
+        return false;
+
+    return cmd_stream_start(period, false);
+}
+
+static bool do_tasks(sys_config_t *config, const char *arg)
+{
+    task_print();
+    return true;
+}
+
+static bool do_latency(sys_config_t *config, const char *arg)
+{
+    if (*arg && strcasecmp(arg, "reset"))
+        return false;
+
+    latency_print(*arg);
+    return true;
+}
+
+static bool do_mem(sys_config_t *config, const char *arg)
+{
+    mem_print();
+    return true;
+}
+
+#ifdef _ISR_STATS_
+static bool do_isr(sys_config_t *config, const char *arg)
+{
+    if (*arg && strcasecmp(arg, "reset"))
+        return false;
+
+    isrstat_print(*arg);
+    return true;
+}
+#endif /* _ISR_STATS_ */
+
+static bool do_stats(sys_config_t *config, const char *arg)
+{
+    sys_stats_t stats;
+    bool reset = false;
+
+    if (*arg)
+    {
+        if (strcasecmp(arg, "reset"))
+            return false;
+
+        reset = true;
+    }
+
+    stats_read(&stats, reset);
+
+    print_p("\r\nStatistics:\r\n\r\n\tuptime ............: ");
+    print_u32(timer_get_ticks());
+    print_p(" ms\r\n\tsolves ............: ");
+    print_u32(stats.solves);
+    print_p("\r\n\treg words .........: ");
+    print_u32(stats.reg_words);
+    print_p("\r\n\trx bytes ..........: ");
+    print_u32(stats.rx_bytes);
+    print_p("\r\n\ttx bytes ..........: ");
+    print_u32(stats.tx_bytes);
+    print_p("\r\n\tuart errors .......: ");
+    print_u32(stats.uart_errors);
+    print_p("\r\n\tcommands ..........: ");
+    print_u32(stats.commands);
+    print_p("\r\n\tcommand failures ..: ");
+    print_u32(stats.command_failures);
+    print_p("\r\n\tunlock events .....: ");
+    print_u32(stats.unlock_events);
+    print_p("\r\n\tmax loop ..........: ");
+    print_u32(stats.max_loop_us);
+    print_p(" us\r\n\r\n");
+
+    return true;
+}
+
+#ifdef _PROFILE_
+static bool do_perf(sys_config_t *config, const char *arg)
+{
+    prof_print_reset();
+    return true;
+}
+#endif /* _PROFILE_ */
+
+#ifdef _TRACE_
+static bool do_trace(sys_config_t *config, const char *arg)
+{
+    if (*arg && strcasecmp(arg, "clear"))
+        return false;
+
+    trace_dump(*arg);
+    return true;
+}
+#endif /* _TRACE_ */
+
+#ifdef _RTC_CALIBRATION_
+static bool do_cal(sys_config_t *config, const char *arg)
+{
+    uint32_t cycles;
+    uint16_t ccmp;
+    int32_t error;
+
+    if (!timer_cal_get(&cycles, &ccmp))
+    {
+        printf("Error: No reference clock measured yet\r\n");
+        return false;
+    }
+
+    error = (int32_t)(cycles - F_CPU);
+
+    print_p("\r\nClock calibration:\r\n\r\n\tcycles/s ..........: ");
+    print_u32(cycles);
+    print_p("\r\n\terror .............: ");
+
+    if (error < 0)
+        putch('-');
+
+    print_u32(((error < 0) ? -error : error) / TIMER_CYCLES_PER_US);
+    print_p(" ppm\r\n\tTCB0 CCMP .........: ");
+    print_u32(ccmp);
+    print_p("\r\n\r\n");
+
+    return true;
+}
+#endif /* _RTC_CALIBRATION_ */
+
+static bool do_reg_write(sys_config_t *config, const char *arg)
+{
+    cmd_slice_t tok;
+    uint16_t reg;
+    uint32_t value;
+
+    if (!cmd_next_token(&arg, &tok) || !parse_u16(tok.s, tok.len, &reg) || reg >= ADF4350_NUM_REGS)
+        return false;
+
+    if (!cmd_next_token(&arg, &tok) || !parse_hex32(tok.s, tok.len, &value))
+        return false;
+
+    return do_reg(reg, value);
+}
+
+static bool do_regs_write(sys_config_t *config, const char *arg)
+{
+    uint32_t regs[ADF4350_NUM_REGS];
+    cmd_slice_t tok;
+    uint8_t i;
+
+    for (i = 0; i < ADF4350_NUM_REGS; i++)
+    {
+        if (!cmd_next_token(&arg, &tok) || !parse_hex32(tok.s, tok.len, &regs[i]))
+            return false;
+    }
+
+    return do_regs(regs);
+}
+
+static bool do_query_tick(sys_config_t *config, const char *arg)
+{
+    print_u32(timer_get_ticks());
+    print_p("\r\n");
+    return true;
+}
+
+static bool do_at(sys_config_t *config, const char *arg)
+{
+    uint32_t regs[ADF4350_NUM_REGS];
+    cmd_slice_t tok;
+    int32_t tick;
+    uint32_t value;
+    bool relative;
+    uint8_t i;
+
+    if (!cmd_next_token(&arg, &tok))
+    {
+        int32_t now = timer_get_ticks();
+
+        print_p("\r\nQueued retunes:\r\n\r\n");
+
+        for (i = 0; retune_queue_get(i, &tick, &value); i++)
+        {
+            print_p("\t");
+            print_u32(tick);
+            print_p(" (+");
+            print_u32(tick - now > 0 ? tick - now : 0);
+            print_p(") R0 0x");
+            print_hex32(value);
+            print_p("\r\n");
+        }
+
+        print_p("\r\n");
+        return true;
+    }
+
+    if (tok.len == 5 && !strncasecmp_P(tok.s, PSTR("clear"), 5))
+    {
+        retune_queue_clear();
+        return true;
+    }
+
+    relative = (*tok.s == '+');
+
+    if (relative)
+    {
+        tok.s++;
+        tok.len--;
+    }
+
+    if (!parse_u32(tok.s, tok.len, &value))
+        return false;
+
+    tick = relative ? timer_get_ticks() + (int32_t)value : (int32_t)value;
+
+    if (!cmd_next_token(&arg, &tok))
+        return false;
+
+    if (tok.len == 4 && !strncasecmp_P(tok.s, PSTR("freq"), 4))
+    {
+        uint64_t freq;
+
+        while (*arg == ' ')
+            arg++;
+
+        if (!parse_freq(arg, strlen(arg), &freq) || !do_solve(config, freq, regs))
+            return false;
+    }
+    else if (tok.len == 4 && !strncasecmp_P(tok.s, PSTR("regs"), 4))
+    {
+        for (i = 0; i < ADF4350_NUM_REGS; i++)
+        {
+            if (!cmd_next_token(&arg, &tok) || !parse_hex32(tok.s, tok.len, &regs[i]) ||
+                ADF4350_REG_ADDR(regs[i]) != i)
+                return false;
+        }
+    }
+    else
     {
-        return parse_param(&config->r_value, PARAM_U16, arg);
+        printf("Error: Only freq and regs can be scheduled\r\n");
+        return false;
     }
-    else if (!stricmp(command, "power"))
+
+    if (!retune_queue_add(tick, regs))
     {
-        return do_power(config, arg);
+        printf("Error: Queue full\r\n");
+        return false;
     }
-    else if (!stricmp(command, "out"))
+
+    return true;
+}
+
+static bool do_power(sys_config_t *config, const char *arg)
+{
+    for (int i = 0; i < 4; i++)
     {
-        return do_on_off(config, arg);
+        if (!strcmp(arg, _g_powerLevels[i]))
+        {
+            config->power = i;
+            return do_freq(config);
+        }
     }
-    else if (!stricmp(command, "show"))
+
+    return false;
+}
+
+static bool do_seq(sys_config_t *config, const char *arg)
+{
+    uint32_t regs[ADF4350_NUM_REGS];
+    cmd_slice_t tok;
+    uint64_t freq;
+    uint64_t step;
+    uint16_t value;
+    bool down;
+
+    if (!cmd_next_token(&arg, &tok))
     {
-        do_show(config);
+        seq_print();
         return true;
     }
-    else if (!stricmp(command, "save"))
+
+    if (tok.len == 3 && !strncasecmp_P(tok.s, PSTR("add"), 3))
     {
-        save_configuration(config);
-        printf("\r\nConfiguration saved.\r\n\r\n");
+        while (*arg == ' ')
+            arg++;
+
+        if (!parse_freq(arg, strlen(arg), &freq) || !do_solve(config, freq, regs))
+            return false;
+
+        if (!seq_add_hop(regs))
+        {
+            printf("Error: List full or R counter differs\r\n");
+            return false;
+        }
+
         return true;
     }
-    else if (!stricmp(command, "default"))
+
+    if (tok.len == 5 && !strncasecmp_P(tok.s, PSTR("sweep"), 5))
     {
-        default_configuration(config);
-        printf("\r\nDefault configuration loaded.\r\n\r\n");
+        if (!cmd_next_token(&arg, &tok) || !parse_freq(tok.s, tok.len, &freq))
+            return false;
+
+        if (!cmd_next_token(&arg, &tok))
+            return false;
+
+        down = (*tok.s == '-');
+
+        if (down)
+        {
+            tok.s++;
+            tok.len--;
+        }
+
+        if (!parse_freq(tok.s, tok.len, &step) || step > INT32_MAX)
+            return false;
+
+        if (!cmd_next_token(&arg, &tok) || !parse_u16(tok.s, tok.len, &value) || !value)
+            return false;
+
+        seq_set_sweep(freq, down ? -(int32_t)step : (int32_t)step, value);
+        return true;
+    }
+
+    if (tok.len == 5 && !strncasecmp_P(tok.s, PSTR("dwell"), 5))
+    {
+        if (!cmd_next_token(&arg, &tok) || !parse_u16(tok.s, tok.len, &value) || !value)
+            return false;
+
+        seq_set_dwell(value);
+        return true;
+    }
+
+    if (tok.len == 3 && !strncasecmp_P(tok.s, PSTR("run"), 3))
+        return seq_start();
+
+    if (tok.len == 4 && !strncasecmp_P(tok.s, PSTR("stop"), 4))
+    {
+        seq_stop();
+        return true;
+    }
+
+    if (tok.len == 5 && !strncasecmp_P(tok.s, PSTR("clear"), 5))
+    {
+        seq_clear();
         return true;
     }
-    else if (!stricmp(command, "reset"))
+
+    if (tok.len == 4 && !strncasecmp_P(tok.s, PSTR("save"), 4))
+    {
+        seq_save();
+        return true;
+    }
+
+    if (tok.len == 4 && !strncasecmp_P(tok.s, PSTR("load"), 4))
+    {
+        seq_stop();
+        seq_load();
+        return true;
+    }
+
+    return false;
+}
+
+static bool do_autorun(sys_config_t *config, const char *arg)
+{
+    if (!strcasecmp(arg, "on"))
+    {
+        config->autorun = true;
+        return true;
+    }
+
+    if (!strcasecmp(arg, "off"))
     {
-        printf("\r\n");
-        while (console_busy());
-        reset();
-        return true;
-    }
-    else if ((!stricmp(command, "help") || !stricmp(command, "?"))) {
-        do_help();
+        config->autorun = false;
         return true;
     }
 
-    printf("Error: No such command (%s)\r\n", command);
     return false;
 }
 
-static bool do_power(sys_config_t *config, const char *arg)
+static bool do_store(sys_config_t *config, const char *arg)
 {
-    for (int i = 0; i < 4; i++)
+    uint32_t regs[ADF4350_NUM_REGS];
+    uint16_t n;
+
+    if (!parse_param(&n, PARAM_U16, arg) || n >= PRESET_COUNT)
+        return false;
+
+    if (!do_solve(config, config->freq, regs))
+        return false;
+
+    return preset_store(n, config, regs);
+}
+
+static bool do_recall(sys_config_t *config, const char *arg)
+{
+    uint32_t regs[ADF4350_NUM_REGS];
+    preset_t preset;
+    uint16_t n;
+
+    if (!parse_param(&n, PARAM_U16, arg) || n >= PRESET_COUNT)
+        return false;
+
+    if (!preset_load(n, &preset))
     {
-        if (!strcmp(arg, _g_powerLevels[i]))
+        printf("Error: Preset empty\r\n");
+        return false;
+    }
+
+    do_fixed_regs(&preset.config, regs);
+    regs[ADF4350_REG0] = preset.r0;
+    regs[ADF4350_REG1] = preset.r1;
+    regs[ADF4350_REG2] = preset.r2;
+    regs[ADF4350_REG4] = preset.r4;
+
+    if (!do_regs(regs))
+        return false;
+
+    config->freq = preset.config.freq;
+    config->r_value = preset.config.r_value;
+    config->power = preset.config.power;
+    config->out_on = preset.config.out_on;
+
+    return true;
+}
+
+static bool do_presets(sys_config_t *config, const char *arg)
+{
+    preset_t preset;
+    uint8_t i;
+
+    print_p("\r\nPresets:\r\n\r\n");
+
+    for (i = 0; i < PRESET_COUNT; i++)
+    {
+        print_p("\t");
+        print_u32(i);
+        print_p(" .................: ");
+
+        if (!preset_load(i, &preset))
         {
-            config->power = i;
-            return do_freq(config);
+            print_p("empty\r\n");
+            continue;
         }
+
+        print_u64_dp(preset.config.freq, 6);
+        print_p(" MHz, r ");
+        print_u32(preset.config.r_value);
+        print_p(", ");
+        print_str(_g_powerLevels[preset.config.power & 3]);
+        print_p(" dBm, out ");
+        print_pstr(preset.config.out_on ? PSTR("on") : PSTR("off"));
+        print_p("\r\n");
     }
 
-    return false;
+    print_p("\r\n");
+
+    return true;
 }
 
 static bool do_on_off(sys_config_t *config, const char *arg)
@@ -239,14 +1027,9 @@ static bool do_on_off(sys_config_t *config, const char *arg)
     return false;
 }
 
-static bool parse_param(void *param, uint8_t type, char *arg)
+static bool parse_param(void *param, uint8_t type, const char *arg)
 {
-    uint8_t u8param;
-    uint16_t u16param;
-    uint64_t u64param;
-    uint8_t dp = 0;
-    uint16_t dpmul;
-    char *s;
+    uint8_t len;
 
     if (!arg || !*arg)
     {
@@ -254,73 +1037,178 @@ static bool parse_param(void *param, uint8_t type, char *arg)
         return false;
     }
 
+    len = strlen(arg);
+
+    // Trailing spaces (frequencies may have one before the unit)
+    while (len && arg[len - 1] == ' ')
+        len--;
+
     switch (type)
     {
-        case PARAM_U8:
-            *(uint8_t *)param = u8param;
-            break;
         case PARAM_U16:
-            s = strtok(arg, ".");
-            u16param = atoi(s);
+            return parse_u16(arg, len, (uint16_t *)param);
+        case PARAM_FREQ:
+            return parse_freq(arg, len, (uint64_t *)param);
+    }
 
-            if (*arg == '-')
-                return false;
+    return false;
+}
 
-            s = strtok(NULL, "");
+static bool parse_u16(const char *s, uint8_t len, uint16_t *value)
+{
+    uint32_t result;
 
-            if (s && *s != 0)
-            {
-                if (dp == 0)
-                    return false;
-                if (dp == 1 && strlen(s) > 1)
-                    return false;
-                
-                u16param += atoi(s);
-            }
+    if (!parse_u32(s, len, &result) || result > UINT16_MAX)
+        return false;
 
-            *(uint16_t *)param = u16param;
-            break;
-        case PARAM_U64:
-        case PARAM_U64_3DP:
-            s = strtok(arg, ".");
-            u64param = atoi(s);
-            switch (type)
-            {
-                case PARAM_U64:
-                    break;
-                case PARAM_U64_3DP:
-                    u64param *= _3DP_BASE;
-                    dp = 3;
-                    dpmul = 100;
-                    break;
-            }
+    *value = result;
+    return true;
+}
+
+static bool parse_u32(const char *s, uint8_t len, uint32_t *value)
+{
+    uint32_t result = 0;
+
+    if (!len)
+        return false;
+
+    for (; len; s++, len--)
+    {
+        if (*s < '0' || *s > '9')
+            return false;
+
+        if (result > (UINT32_MAX - 9) / 10)
+            return false;
+
+        result = result * 10 + (*s - '0');
+    }
+
+    *value = result;
+    return true;
+}
+
+static bool parse_hex32(const char *s, uint8_t len, uint32_t *value)
+{
+    uint32_t result = 0;
+
+    if (len > 2 && s[0] == '0' && (s[1] | 0x20) == 'x')
+    {
+        s += 2;
+        len -= 2;
+    }
+
+    if (!len || len > 8)
+        return false;
+
+    for (; len; s++, len--)
+    {
+        char c = *s | 0x20;
+
+        if (*s >= '0' && *s <= '9')
+            result = (result << 4) | (*s - '0');
+        else if (c >= 'a' && c <= 'f')
+            result = (result << 4) | (c - 'a' + 10);
+        else
+            return false;
+    }
+
+    *value = result;
+    return true;
+}
+
+/*
+ * Single pass frequency parser. Accepts e.g. "2400.05", "2400.05MHz",
+ * "145500 kHz" or "4.4G". A bare number is taken to be in MHz. Anything
+ * which would need better than 1 Hz resolution is rejected.
+ */
+static bool parse_freq(const char *s, uint8_t len, uint64_t *hz)
+{
+    const char *end = s + len;
+    uint64_t value = 0;
+    uint8_t digits = 0;
+    int8_t frac = -1;
+    uint8_t exp = 6;
 
-            if (*arg == '-')
+    for (; s < end; s++)
+    {
+        if (*s >= '0' && *s <= '9')
+        {
+            if (value > (UINT64_MAX - 9) / 10)
                 return false;
 
-            s = strtok(NULL, "");
+            value = value * 10 + (*s - '0');
+            digits++;
 
-            if (s && *s != 0)
-            {
-                size_t dplen = strlen(s);
-
-                if (dp == 0)
-                    return false;
-                if (dp == 3 &&  dplen > 3)
-                    return false;
-               
-                if (dplen == 1)
-                    u64param += atoi(s) * (dpmul / 1);
-                else if (dplen == 2)
-                    u64param += atoi(s) * (dpmul / 10);
-                else if (dplen == 3)
-                    u64param += atoi(s) * (dpmul / 100);
-            }
-            
-            *(uint64_t *)param = u64param;
+            if (frac >= 0)
+                frac++;
+        }
+        else if (*s == '.' && frac < 0)
+        {
+            frac = 0;
+        }
+        else
+        {
             break;
+        }
+    }
+
+    if (!digits)
+        return false;
+
+    while (s < end && *s == ' ')
+        s++;
+
+    if (s < end)
+    {
+        switch (*s | 0x20)
+        {
+            case 'g':
+                exp = 9;
+                s++;
+                break;
+            case 'm':
+                s++;
+                break;
+            case 'k':
+                exp = 3;
+                s++;
+                break;
+            case 'h':
+                exp = 0;
+                break;
+            default:
+                return false;
+        }
+    }
+
+    if (s < end && (*s | 0x20) == 'h')
+    {
+        if (s + 1 >= end || (s[1] | 0x20) != 'z')
+            return false;
+        s += 2;
+    }
+
+    if (s != end)
+        return false;
+
+    if (frac < 0)
+        frac = 0;
+
+    for (; frac > exp; frac--)
+    {
+        if (value % 10)
+            return false; /* Finer than 1 Hz */
+        value /= 10;
+    }
+
+    for (; exp > frac; exp--)
+    {
+        if (value > UINT64_MAX / 10)
+            return false;
+        value *= 10;
     }
 
+    *hz = value;
     return true;
 }
 
@@ -332,11 +1220,11 @@ void cmd_init(void)
     {
         _g_cmd[i].count = 0;
         _g_cmd[i].state = CMD_NONE;
-        _g_cmd[i].next_history = 0;
+        _g_cmd[i].history_used = 0;
+        _g_cmd[i].history_count = 0;
         _g_cmd[i].show_history = 0;
-        _g_cmd[i].max_history = 0;
         _g_cmd[i].ignore_lf = 0;
-        memset(_g_cmd[i].cmd_history, 0, CMD_MAX_HISTORY * CMD_MAX_LINE);
+        _g_cmd[i].stream_period = 0;
         memset(_g_cmd[i].cmd_buf, 0, CMD_MAX_LINE);
     }
     
@@ -345,7 +1233,7 @@ void cmd_init(void)
 
 void cmd_process_state(sys_config_t *config)
 {
-    uint8_t idx, i;
+    uint8_t idx;
 
     for (idx = 0; idx < CMD_MAX_CONSOLE; idx++)
     {
@@ -359,54 +1247,28 @@ void cmd_process_state(sys_config_t *config)
         }
         else if (ccmd->state == CMD_PREVCOMMAND)
         {
-            uint8_t previdx;
-
-            if (!ccmd->max_history)
+            if (ccmd->history_count)
             {
-                ccmd->state = CMD_READLINE;
-                return;
-            }
-
-            if (ccmd->count)
-                cmd_erase_line(ccmd);
+                if (++ccmd->show_history > ccmd->history_count)
+                    ccmd->show_history = 1;
 
-            if (ccmd->show_history == 0)
-                ccmd->show_history = CMD_MAX_HISTORY;
-
-            previdx = --ccmd->show_history;
-
-            strcpy(ccmd->cmd_buf, ccmd->cmd_history[previdx]);
-            ccmd->count = strlen(ccmd->cmd_buf);
-            printf("%s", ccmd->cmd_buf);
+                cmd_history_show(ccmd);
+            }
 
             ccmd->state = CMD_READLINE;
-
         }
         else if (ccmd->state == CMD_NEXTCOMMAND)
         {
-            uint8_t previdx;
-
-            if (!ccmd->max_history)
+            if (ccmd->history_count)
             {
-                ccmd->state = CMD_READLINE;
-                return;
-            }
-
-            if (ccmd->count)
-                cmd_erase_line(ccmd);
-
-            previdx = ++ccmd->show_history;
+                if (ccmd->show_history <= 1)
+                    ccmd->show_history = ccmd->history_count;
+                else
+                    ccmd->show_history--;
 
-            if (ccmd->show_history == CMD_MAX_HISTORY)
-            {
-                ccmd->show_history = 0;
-                previdx = 0;
+                cmd_history_show(ccmd);
             }
 
-            strcpy(ccmd->cmd_buf, ccmd->cmd_history[previdx]);
-            ccmd->count = strlen(ccmd->cmd_buf);
-            printf("%s", ccmd->cmd_buf);
-
             ccmd->state = CMD_READLINE;
         }
         else if (ccmd->state == CMD_COMPLETE)
@@ -416,41 +1278,11 @@ void cmd_process_state(sys_config_t *config)
             
             if (ccmd->count > 0)
             {
-                int8_t tostore = -1;
                 bool ret;
 
-                if (ccmd->next_history >= CMD_MAX_HISTORY)
-                    ccmd->next_history = 0;
-                else
-                    ccmd->max_history++;
-
-                for (i = 0; i < CMD_MAX_HISTORY; i++)
-                {
-                    if (!strcasecmp(ccmd->cmd_history[i], ccmd->cmd_buf))
-                    {
-                        tostore = i;
-                        break;
-                    }
-                }
-
-                if (tostore < 0)
-                {
-                    // Don't have this command in history. Store it
-                    strcpy(ccmd->cmd_history[ccmd->next_history], ccmd->cmd_buf);
-                    ccmd->next_history++;
-                    ccmd->show_history = ccmd->next_history;
-                }
-                else
-                {
-                    // Already have this command in history, set the 'up' arrow to retrieve it.
-                    tostore++;
-
-                    if (tostore == CMD_MAX_HISTORY)
-                        tostore = 0;
+                cmd_history_add(ccmd);
+                ccmd->show_history = 0;
 
-                    ccmd->show_history = tostore;
-                }
-                
                 ret = command_prompt_handler(ccmd->cmd_buf, config);
 
                 if (!ret)
@@ -465,7 +1297,106 @@ void cmd_process_state(sys_config_t *config)
             printf("\r\n");
             cmd_prompt(ccmd);
         }
+        else if (ccmd->state == CMD_BINARY_COMPLETE)
+        {
+            uint32_t start = now_us();
+
+            TRACE(TRACE_CMD, 0x80 | idx);
+            proto_handle((uint8_t *)ccmd->cmd_buf, ccmd->count, config);
+            latency_note(PSTR("(binary frame)"), true, now_us() - start);
+            ccmd->state = CMD_READLINE;
+            ccmd->count = 0;
+        }
+        else if (ccmd->state == CMD_BINARY)
+        {
+            if (timer_get_ticks() - ccmd->frame_tick > PROTO_TIMEOUT_MS)
+            {
+                ccmd->state = CMD_READLINE;
+                ccmd->count = 0;
+            }
+        }
+
+        if (ccmd->save_pending && !eeprom_write_busy() && ccmd->state == CMD_READLINE)
+        {
+            uint8_t i;
+
+            ccmd->save_pending = false;
+            printf("\r\nConfiguration saved.\r\n\r\ncmd>");
+
+            for (i = 0; i < ccmd->count; i++)
+                putch(ccmd->cmd_buf[i]);
+        }
+    }
+}
+
+/*
+ * Returns the nth newest history entry (1 = newest). History is packed
+ * as length prefixed strings, oldest first.
+ */
+static uint8_t *cmd_history_entry(cmd_state_t *ccmd, uint8_t n)
+{
+    uint8_t *entry = ccmd->history;
+    uint8_t skip = ccmd->history_count - n;
+
+    while (skip--)
+        entry += *entry + 1;
+
+    return entry;
+}
+
+static void cmd_history_remove(cmd_state_t *ccmd, uint8_t *entry)
+{
+    uint8_t size = *entry + 1;
+    uint8_t *next = entry + size;
+
+    memmove(entry, next, ccmd->history + ccmd->history_used - next);
+    ccmd->history_used -= size;
+    ccmd->history_count--;
+}
+
+static void cmd_history_add(cmd_state_t *ccmd)
+{
+    uint8_t len = ccmd->count;
+    uint8_t i;
+
+    if (len + 1 > CMD_HISTORY_SIZE)
+        return;
+
+    // Drop any identical entry so that it moves to the newest position
+    for (i = 1; i <= ccmd->history_count; i++)
+    {
+        uint8_t *entry = cmd_history_entry(ccmd, i);
+
+        if (*entry == len && !strncasecmp((char *)entry + 1, ccmd->cmd_buf, len))
+        {
+            cmd_history_remove(ccmd, entry);
+            break;
+        }
     }
+
+    // Evict the oldest entries until the new one fits
+    while (ccmd->history_used + len + 1 > CMD_HISTORY_SIZE)
+        cmd_history_remove(ccmd, ccmd->history);
+
+    ccmd->history[ccmd->history_used] = len;
+    memcpy(ccmd->history + ccmd->history_used + 1, ccmd->cmd_buf, len);
+    ccmd->history_used += len + 1;
+    ccmd->history_count++;
+}
+
+static void cmd_history_show(cmd_state_t *ccmd)
+{
+    uint8_t *entry = cmd_history_entry(ccmd, ccmd->show_history);
+    uint8_t i;
+
+    if (ccmd->count)
+        cmd_erase_line(ccmd);
+
+    ccmd->count = *entry;
+    memcpy(ccmd->cmd_buf, entry + 1, ccmd->count);
+
+    for (i = 0; i < ccmd->count; i++)
+        putch(ccmd->cmd_buf[i]);
 }
 
 static void cmd_erase_line(cmd_state_t *ccmd)
@@ -484,8 +1415,20 @@ void cmd_process_char(uint8_t c, uint8_t idx)
 {
     cmd_state_t *ccmd = &_g_cmd[idx];
     _g_current_console = idx;
-    
-    if (ccmd->state == CMD_ESCAPE) {
+
+    if (ccmd->state == CMD_BINARY) {
+        ccmd->cmd_buf[ccmd->count++] = c;
+
+        if (ccmd->count >= PROTO_HEADER_LEN &&
+            (ccmd->count == (uint8_t)ccmd->cmd_buf[1] + PROTO_HEADER_LEN + 1 || ccmd->count >= CMD_MAX_LINE))
+            ccmd->state = CMD_BINARY_COMPLETE;
+
+        return;
+    }
+    else if (ccmd->state == CMD_BINARY_COMPLETE) {
+        return; /* Host must wait for the reply */
+    }
+    else if (ccmd->state == CMD_ESCAPE) {
         if (c == SEQ_CTRL_CHAR1) {
             ccmd->state = CMD_AWAIT_NAV;
             return;
@@ -541,6 +1484,12 @@ void cmd_process_char(uint8_t c, uint8_t idx)
             return;
         }
 
+        if (c == PROTO_SOH && !ccmd->count) {
+            ccmd->state = CMD_BINARY;
+            ccmd->frame_tick = timer_get_ticks();
+            return;
+        }
+
         if (c == CTL_XOFF) /* Swallow XOFF */
             return;
         
@@ -603,14 +1552,144 @@ void cmd_process_char(uint8_t c, uint8_t idx)
     }
 }
 
+/*
+ * Starts (or with a period of 0, stops) periodic telemetry on the current console.
+ */
+bool cmd_stream_start(uint16_t period_ms, bool binary)
+{
+    cmd_state_t *ccmd = &_g_cmd[_g_current_console];
+
+    cmd_stream_stop(ccmd);
+
+    if (!period_ms)
+        return true;
+
+    ccmd->stream_task = task_add(_g_task_stream, cmd_stream_task, _g_current_console,
+        period_ms, timer_get_ticks() + period_ms);
+
+    if (ccmd->stream_task == TASK_NONE)
+        return false;
+
+    ccmd->stream_period = period_ms;
+    ccmd->stream_binary = binary;
+
+    return true;
+}
+
+static void cmd_stream_stop(cmd_state_t *ccmd)
+{
+    if (!ccmd->stream_period)
+        return;
+
+    task_remove(ccmd->stream_task);
+    ccmd->stream_period = 0;
+}
+
+static void cmd_stream_task(sys_config_t *config, uint8_t idx)
+{
+    cmd_state_t *ccmd = &_g_cmd[idx];
+    proto_telemetry_t rec;
+    sys_stats_t stats;
+
+    _g_current_console = idx;
+
+    stats_read(&stats, false);
+
+    rec.tick_count = timer_get_ticks();
+    rec.lock = IO_IN_HIGH(LD);
+    rec.freq_index = _g_counters.freq_index;
+    rec.unlock_events = stats.unlock_events;
+    rec.uart_errors = stats.uart_errors;
+    rec.command_failures = stats.command_failures;
+    rec.solves = stats.solves;
+
+    if (ccmd->stream_binary)
+    {
+        proto_reply(PROTO_OP_TELEMETRY, PROTO_OK, &rec, sizeof(rec));
+        return;
+    }
+
+    putch('$');
+    print_u32(rec.tick_count);
+    putch(',');
+    putch('0' + rec.lock);
+    putch(',');
+    print_u32(rec.freq_index);
+    putch(',');
+    print_u32(rec.unlock_events);
+    putch(',');
+    print_u32(rec.uart_errors);
+    putch(',');
+    print_u32(rec.command_failures);
+    putch(',');
+    print_u32(rec.solves);
+    print_p("\r\n");
+}
+
+static bool cmd_data_ready(uint8_t idx)
+{
+#ifdef _USART1_
+    if (idx == CONSOLE_2)
+        return console2_data_ready();
+#endif
+    return console_data_ready();
+}
+
+static char cmd_get(uint8_t idx)
+{
+#ifdef _USART1_
+    if (idx == CONSOLE_2)
+        return console2_get();
+#endif
+    return console_get();
+}
+
 void cmd_process(sys_config_t *config)
 {
     uint8_t i;
     for (i = 0; i < CMD_MAX_CONSOLE; i++)
     {
-        if (console_data_ready())
-            cmd_process_char(console_get(), CONSOLE_1);
+        if (cmd_data_ready(i))
+        {
+            cmd_state_t *ccmd = &_g_cmd[i];
+
+            if (ccmd->stream_period && !ccmd->stream_binary)
+            {
+                /* Any byte stops a text stream and is then discarded */
+                cmd_get(i);
+                cmd_stream_stop(ccmd);
+                ccmd->state = CMD_NONE;
+            }
+            else if (ccmd->stream_period)
+            {
+                /* Stop a binary stream but keep the byte, it may be the SOH of a frame */
+                cmd_stream_stop(ccmd);
+                cmd_process_char(cmd_get(i), i);
+            }
+            else
+            {
+                cmd_process_char(cmd_get(i), i);
+            }
+        }
     }
 
     cmd_process_state(config);
 }
+
+/*
+ * True if any console still has received bytes waiting. cmd_process()
+ * takes one byte per console per pass, so the idle loop must not sleep
+ * while this holds.
+ */
+bool cmd_rx_pending(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < CMD_MAX_CONSOLE; i++)
+    {
+        if (cmd_data_ready(i))
+            return true;
+    }
+
+    return false;
+}
@@ -22,16 +22,23 @@
 #define __CMD_H__
 
 #define CONSOLE_1               0x00
+#define CONSOLE_2               0x01
 
-#define CMD_MAX_LINE            64
+/* Longest table entry, "at +2147483647 regs" and six 0x-prefixed words, plus NUL */
+#define CMD_MAX_LINE            88
 
 #define SO_SEND_UPDATE          0x01
 #define SO_MASK_IRQ             0x04
 #define SO_UNMASK_IRQ           0x08
 
+extern uint8_t _g_current_console;
+
 void cmd_process(sys_config_t *config);
+bool cmd_rx_pending(void);
+bool cmd_table_check(void);
 void cmd_init(void);
-bool command_prompt_handler(char *text, sys_config_t *config);
+bool command_prompt_handler(const char *text, sys_config_t *config);
+bool cmd_stream_start(uint16_t period_ms, bool binary);
 bool set_output(bool state, uint8_t flags);
 #ifdef _HAVE_SWITCH_ON_SCK_
 bool set_gpio_output(bool state, uint8_t flags);
@@ -40,6 +47,12 @@ void dump_state(void);
 void set_suspend(bool suspended);
 
 bool do_freq(sys_config_t *config);
+bool do_solve(sys_config_t *config, uint64_t freq, uint32_t *regs);
+bool do_reg(uint8_t reg, uint32_t value);
+bool do_regs(const uint32_t *regs);
+void do_fixed_regs(sys_config_t *config, uint32_t *regs);
 void do_state(void);
+uint64_t do_actual_freq(void);
+void do_save_config(sys_config_t *config, const uint32_t *regs);
 
 #endif /* __CMD_H__ */
\ No newline at end of file
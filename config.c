@@ -21,24 +21,67 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
 #include <avr/pgmspace.h>
+#include <util/crc16.h>
 
 #include "config.h"
 #include "util.h"
+#include "adf4350.h"
 
-void load_configuration(sys_config_t *config)
+static bool journal_read(uint8_t slot, journal_record_t *record);
+static uint8_t journal_crc(journal_record_t *record);
+
+_Static_assert(sizeof(journal_record_t) * JOURNAL_SLOTS <= EEPROM_PRESET_ADDR, "Journal overlaps the presets");
+_Static_assert(sizeof(preset_t) <= EEPROM_PRESET_SIZE, "preset_t does not fit EEPROM_PRESET_SIZE");
+
+static uint8_t _g_journal_slot;
+static uint8_t _g_journal_seq;
+
+void load_configuration(sys_config_t *config, boot_record_t *boot)
 {
-    uint16_t config_size = sizeof(sys_config_t);
-    if (config_size > 0x100)
-        reset();
-    
-    eeprom_read_data(0, (uint8_t *)config, sizeof(sys_config_t));
+    journal_record_t record;
+    uint8_t seq[JOURNAL_SLOTS];
+    uint8_t candidates = (1 << JOURNAL_SLOTS) - 1;
+    uint8_t newest;
+    uint8_t i;
 
-    if (config->magic != CONFIG_MAGIC)
+    for (i = 0; i < JOURNAL_SLOTS; i++)
+        eeprom_read_data(EEPROM_JOURNAL_ADDR + i * sizeof(journal_record_t), &seq[i], 1);
+
+    // Try the newest first, falling back to older records if it is torn
+    while (candidates)
     {
-        default_configuration(config);
-        save_configuration(config);
+        newest = JOURNAL_SLOTS;
+
+        for (i = 0; i < JOURNAL_SLOTS; i++)
+        {
+            if (!(candidates & (1 << i)))
+                continue;
+
+            if (newest == JOURNAL_SLOTS || (int8_t)(seq[i] - seq[newest]) > 0)
+                newest = i;
+        }
+
+        if (journal_read(newest, &record) && record.config.magic == CONFIG_MAGIC)
+        {
+            _g_journal_slot = newest;
+            _g_journal_seq = record.seq;
+            *config = record.config;
+            *boot = record.boot;
+            return;
+        }
+
+        candidates &= ~(1 << newest);
     }
+
+    _g_journal_slot = JOURNAL_SLOTS - 1;
+    _g_journal_seq = 0xFF;
+
+    default_configuration(config);
+    memset(boot, 0, sizeof(boot_record_t));
+    save_configuration(config, boot);
 }
 
 void default_configuration(sys_config_t *config)
@@ -48,9 +91,68 @@ void default_configuration(sys_config_t *config)
     config->r_value = DEFAULT_R;
     config->power = DEFAULT_POWER;
     config->out_on = false;
+    config->autorun = false;
+}
+
+void save_configuration(sys_config_t *config, boot_record_t *boot)
+{
+    journal_record_t record;
+
+    if (++_g_journal_slot >= JOURNAL_SLOTS)
+        _g_journal_slot = 0;
+
+    record.seq = ++_g_journal_seq;
+    record.config = *config;
+    record.boot = *boot;
+    record.crc = journal_crc(&record);
+
+    eeprom_write_data(EEPROM_JOURNAL_ADDR + _g_journal_slot * sizeof(journal_record_t),
+        (uint8_t *)&record, sizeof(journal_record_t));
+}
+
+static bool journal_read(uint8_t slot, journal_record_t *record)
+{
+    eeprom_read_data(EEPROM_JOURNAL_ADDR + slot * sizeof(journal_record_t), (uint8_t *)record, sizeof(journal_record_t));
+
+    return journal_crc(record) == record->crc;
 }
 
-void save_configuration(sys_config_t *config)
+static uint8_t journal_crc(journal_record_t *record)
 {
-    eeprom_write_data(0, (uint8_t *)config, sizeof(sys_config_t));
+    const uint8_t *p = (const uint8_t *)record;
+    uint8_t crc = 0;
+    uint8_t i;
+
+    for (i = 0; i < offsetof(journal_record_t, crc); i++)
+        crc = _crc8_ccitt_update(crc, *p++);
+
+    return crc;
+}
+
+bool preset_store(uint8_t n, sys_config_t *config, const uint32_t *regs)
+{
+    preset_t preset;
+
+    if (n >= PRESET_COUNT)
+        return false;
+
+    preset.config = *config;
+    preset.r0 = regs[ADF4350_REG0];
+    preset.r1 = regs[ADF4350_REG1];
+    preset.r2 = regs[ADF4350_REG2];
+    preset.r4 = regs[ADF4350_REG4];
+
+    eeprom_write_data(EEPROM_PRESET_ADDR + n * EEPROM_PRESET_SIZE, (uint8_t *)&preset, sizeof(preset_t));
+
+    return true;
+}
+
+bool preset_load(uint8_t n, preset_t *preset)
+{
+    if (n >= PRESET_COUNT)
+        return false;
+
+    eeprom_read_data(EEPROM_PRESET_ADDR + n * EEPROM_PRESET_SIZE, (uint8_t *)preset, sizeof(preset_t));
+
+    return preset->config.magic == CONFIG_MAGIC;
 }
@@ -19,16 +19,69 @@
 #ifndef __CONFIG_H__
 #define __CONFIG_H__
 
+/* EEPROM layout */
+#define EEPROM_JOURNAL_ADDR     0x00
+#define EEPROM_PRESET_ADDR      0x70
+#define EEPROM_PRESET_SIZE      0x20 /* Per slot */
+#define EEPROM_SEQ_ADDR         0xB0
+#define EEPROM_SEQ_SIZE         0x50
+
 typedef struct {
     uint16_t magic;
-    uint64_t freq;
+    uint64_t freq; /* Hz */
     uint16_t r_value;
     uint8_t power;
     bool out_on;
+    bool autorun; /* Start the stored sequence at boot */
 } sys_config_t;
 
-void load_configuration(sys_config_t *config);
+/*
+ * Registers committed for the saved configuration, written straight to
+ * the synthesizer at power on if hash still matches the configuration.
+ * R3 and R5 are rebuilt from the platform settings.
+ */
+typedef struct {
+    uint16_t hash;      /* 0 = no registers stored */
+    uint32_t r0;
+    uint32_t r1;
+    uint32_t r2;
+    uint32_t r4;
+} boot_record_t;
+
+#define JOURNAL_SLOTS           3
+
+/*
+ * Saves rotate through the journal slots so no one slot takes every
+ * write. The newest record is the one with the highest seq (serial
+ * number arithmetic) that also passes its CRC, so a save cut short by
+ * power loss falls back to the one before.
+ */
+typedef struct {
+    uint8_t seq;
+    sys_config_t config;
+    boot_record_t boot;
+    uint8_t crc; /* CRC8 of all of the above */
+} journal_record_t;
+
+#define PRESET_COUNT            2
+
+/*
+ * A preset keeps the settings along with the registers solved for them,
+ * so recalling one needs no solver run. R3 and R5 only depend on the
+ * platform settings and are not stored. config.magic marks a used slot.
+ */
+typedef struct {
+    sys_config_t config;
+    uint32_t r0;
+    uint32_t r1;
+    uint32_t r2;
+    uint32_t r4;
+} preset_t;
+
+void load_configuration(sys_config_t *config, boot_record_t *boot);
 void default_configuration(sys_config_t *config);
-void save_configuration(sys_config_t *config);
+void save_configuration(sys_config_t *config, boot_record_t *boot);
+bool preset_store(uint8_t n, sys_config_t *config, const uint32_t *regs);
+bool preset_load(uint8_t n, preset_t *preset);
 
 #endif /* __CONFIG_H__ */
@@ -19,16 +19,37 @@
 #ifndef __COUNTERS_H__
 #define	__COUNTERS_H__
 
+/*
+ * Runtime statistics, see 'stats' and PROTO_OP_STATS. Fields written
+ * from ISRs must be read with interrupts off (stats_read()).
+ */
+typedef struct
+{
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+    uint32_t reg_words;         /* Words shifted out to the synthesizer */
+    uint16_t solves;
+    uint16_t uart_errors;       /* Framing, hardware and ring buffer overruns */
+    uint16_t commands;          /* Text and binary */
+    uint16_t command_failures;
+    uint16_t unlock_events;
+    uint16_t max_loop_us;       /* Longest single pass of the idle loop */
+} sys_stats_t;
+
 typedef struct
 {
     int32_t tick_count;
+#ifdef _I2C_XFER_
     volatile uint16_t i2c_timeout_cnt;
     uint16_t i2c_timeouts;
-    volatile uint16_t xbee_timeout_cnt;
-    uint16_t xbee_timeouts;
+#endif /* _I2C_XFER_ */
+    uint8_t freq_index; /* Position in the running hop/sweep sequence */
+    sys_stats_t stats;
 } sys_counters_t;
 
 extern sys_counters_t _g_counters;
 
+void stats_read(sys_stats_t *stats, bool reset);
+
 #endif	/* __COUNTERS_H__ */
 
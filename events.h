@@ -0,0 +1,44 @@
+/*
+ *   File:   events.h
+ *   Author: Matt
+ *
+ *   Created on 18 Oct 2026, 19:40
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __EVENTS_H__
+#define __EVENTS_H__
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#define EV_RX                   0x01
+#define EV_TICK                 0x02
+#define EV_LD                   0x04
+#define EV_EEPROM               0x08
+
+/*
+ * Set by ISRs to say there is work for the idle loop, which clears it
+ * before each pass and only sleeps if nothing came in meanwhile.
+ */
+extern volatile uint8_t _g_events;
+
+#ifdef _TCB0_LVL1_
+/* A level 1 TCB0 could land between the read and write of a level 0 post */
+#define event_post(ev)          do { uint8_t _sreg = SREG; cli(); _g_events |= (ev); SREG = _sreg; } while (0)
+#else
+#define event_post(ev)          (_g_events |= (ev))
+#endif
+
+#endif /* __EVENTS_H__ */
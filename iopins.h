@@ -50,6 +50,8 @@
 #define LE_PORT             PORTA.OUT
 
 #define LD_DDR              PORTA.DIR
+#define LD_PINCTRL          PORTA.PIN4CTRL
+#define LD_INTFLAGS         PORTA.INTFLAGS
 #define CLOCK_DDR           PORTA.DIR
 #define DATA_DDR            PORTA.DIR
 #define LE_DDR              PORTA.DIR
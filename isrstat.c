@@ -0,0 +1,139 @@
+/*
+ *   File:   isrstat.c
+ *   Author: Matt
+ *
+ *   Created on 19 Oct 2026, 14:40
+ *
+ *   Per-interrupt worst case duration, and latency for TCB0, stamped
+ *   from TCB0.CNT. Built with _ISR_STATS_ only.
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#ifdef _ISR_STATS_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "isrstat.h"
+#include "timer.h"
+#include "util.h"
+
+typedef struct
+{
+    uint32_t count;
+    uint16_t max_cycles;
+    uint16_t max_latency;
+} isrstat_t;
+
+static const char _g_isrstat_tcb0[] PROGMEM = "TCB0";
+static const char _g_isrstat_rxc0[] PROGMEM = "USART0 RXC";
+static const char _g_isrstat_dre0[] PROGMEM = "USART0 DRE";
+static const char _g_isrstat_rxc1[] PROGMEM = "USART1 RXC";
+static const char _g_isrstat_dre1[] PROGMEM = "USART1 DRE";
+static const char _g_isrstat_porta[] PROGMEM = "PORTA";
+static const char _g_isrstat_nvm[] PROGMEM = "NVM EE";
+static const char _g_isrstat_rtc[] PROGMEM = "RTC CNT";
+
+static const char * const _g_isrstat_names[ISRSTAT_SOURCES] PROGMEM =
+{
+    _g_isrstat_tcb0,
+    _g_isrstat_rxc0,
+    _g_isrstat_dre0,
+    _g_isrstat_rxc1,
+    _g_isrstat_dre1,
+    _g_isrstat_porta,
+    _g_isrstat_nvm,
+    _g_isrstat_rtc
+};
+
+static isrstat_t _g_isrstats[ISRSTAT_SOURCES];
+
+/*
+ * Called at the end of each handler. A handler that spans a tick sees
+ * CNT go backwards, so the period is added back. Each source only ever
+ * updates its own slot, but a LVL1 TCB0 can still pre-empt the others,
+ * hence the atomic block.
+ */
+void isrstat_record(uint8_t src, uint16_t entry, uint16_t exit)
+{
+    isrstat_t *s = &_g_isrstats[src];
+    uint16_t cycles = exit - entry;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (exit < entry)
+            cycles += TCB0.CCMP + 1;
+
+        s->count++;
+
+        if (cycles > s->max_cycles)
+            s->max_cycles = cycles;
+
+        if (src == ISRSTAT_TCB0 && entry > s->max_latency)
+            s->max_latency = entry;
+    }
+}
+
+uint16_t isrstat_cnt(void)
+{
+    uint16_t cnt;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        cnt = TCB0.CNT;
+    }
+
+    return cnt;
+}
+
+void isrstat_print(bool reset)
+{
+    isrstat_t stats[ISRSTAT_SOURCES];
+    uint8_t i;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memcpy(stats, _g_isrstats, sizeof(stats));
+
+        if (reset)
+            memset(_g_isrstats, 0, sizeof(_g_isrstats));
+    }
+
+    print_p("\r\nInterrupts (cycles):\r\n\r\n\tsource      count      max time   max latency\r\n");
+
+    for (i = 0; i < ISRSTAT_SOURCES; i++)
+    {
+        isrstat_t *s = &stats[i];
+
+        if (!s->count)
+            continue;
+
+        printf("\t%-11S %-10lu %-10u ", pgm_read_ptr(&_g_isrstat_names[i]), s->count, s->max_cycles);
+
+        if (i == ISRSTAT_TCB0)
+            printf("%u\r\n", s->max_latency);
+        else
+            print_p("-\r\n");
+    }
+
+    print_p("\r\n");
+}
+
+#endif /* _ISR_STATS_ */
@@ -0,0 +1,66 @@
+/*
+ *   File:   isrstat.h
+ *   Author: Matt
+ *
+ *   Created on 19 Oct 2026, 14:40
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ISRSTAT_H__
+#define __ISRSTAT_H__
+
+#define ISRSTAT_TCB0            0
+#define ISRSTAT_USART0_RXC      1
+#define ISRSTAT_USART0_DRE      2
+#define ISRSTAT_USART1_RXC      3
+#define ISRSTAT_USART1_DRE      4
+#define ISRSTAT_PORTA           5
+#define ISRSTAT_NVM_EE          6
+#define ISRSTAT_RTC_CNT         7
+#define ISRSTAT_SOURCES         8
+
+#ifdef _ISR_STATS_
+
+#include <avr/io.h>
+
+/*
+ * Stamps are TCB0.CNT, so cost one 16-bit read on entry. TCB0 clears
+ * CNT on its compare match, making its entry stamp the latency from the
+ * tick to the first line of the handler.
+ */
+#ifdef _TCB0_LVL1_
+/*
+ * A level 1 TCB0 reading CNT between the two byte reads of a level 0
+ * handler would overwrite the shared TEMP register, so level 0 reads
+ * are made with interrupts off. TCB0 itself can't be pre-empted.
+ */
+#define ISRSTAT_CNT(src)        ((src) == ISRSTAT_TCB0 ? TCB0.CNT : isrstat_cnt())
+#else
+#define ISRSTAT_CNT(src)        TCB0.CNT
+#endif /* _TCB0_LVL1_ */
+
+#define ISRSTAT_BEGIN(src)      uint16_t _isrstat_entry = ISRSTAT_CNT(src)
+#define ISRSTAT_END(src)        isrstat_record(src, _isrstat_entry, ISRSTAT_CNT(src))
+
+void isrstat_record(uint8_t src, uint16_t entry, uint16_t exit);
+uint16_t isrstat_cnt(void);
+void isrstat_print(bool reset);
+
+#else
+
+#define ISRSTAT_BEGIN(src)
+#define ISRSTAT_END(src)
+
+#endif /* _ISR_STATS_ */
+
+#endif /* __ISRSTAT_H__ */
@@ -0,0 +1,139 @@
+/*
+ *   File:   latency.c
+ *   Author: Matt
+ *
+ *   Created on 18 Oct 2026, 23:10
+ *
+ *   Histogram of the gap between successive passes of the idle loop,
+ *   and what ran during the worst one. With the CPU asleep between
+ *   events a quiet loop shows gaps of up to one tick.
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "latency.h"
+#include "util.h"
+
+typedef struct
+{
+    uint16_t buckets[LATENCY_BUCKETS];
+    uint32_t last;                          /* Start of the previous pass, us */
+    bool started;
+    uint32_t worst_us;
+    char worst_name[LATENCY_NAME_LEN];      /* Longest item in the worst pass */
+    uint32_t item_us;                       /* Longest item in the current pass */
+    char item_name[LATENCY_NAME_LEN];
+} latency_t;
+
+static latency_t _g_latency;
+
+/*
+ * Called at the start of every pass. The gap since the previous call
+ * covers the previous pass, so that pass's longest item is what gets
+ * blamed if the gap is a new worst.
+ */
+void latency_pass(uint32_t now)
+{
+    latency_t *lat = &_g_latency;
+    uint32_t gap = now - lat->last;
+    uint8_t bucket = 0;
+
+    lat->last = now;
+
+    if (!lat->started)
+    {
+        lat->started = true;
+        return;
+    }
+
+    while ((gap >> 1) >= ((uint32_t)1 << bucket) && bucket < LATENCY_BUCKETS - 1)
+        bucket++;
+
+    if (lat->buckets[bucket] != UINT16_MAX)
+        lat->buckets[bucket]++;
+
+    if (gap > lat->worst_us)
+    {
+        lat->worst_us = gap;
+        memcpy(lat->worst_name, lat->item_name, LATENCY_NAME_LEN);
+    }
+
+    lat->item_us = 0;
+    lat->item_name[0] = 0;
+}
+
+/*
+ * Records something that ran during this pass (a command, a binary
+ * frame or a task) if it is the longest so far.
+ */
+void latency_note(const char *name, bool progmem, uint32_t us)
+{
+    latency_t *lat = &_g_latency;
+
+    if (us < lat->item_us)
+        return;
+
+    lat->item_us = us;
+
+    if (progmem)
+        strncpy_P(lat->item_name, name, LATENCY_NAME_LEN - 1);
+    else
+        strncpy(lat->item_name, name, LATENCY_NAME_LEN - 1);
+
+    lat->item_name[LATENCY_NAME_LEN - 1] = 0;
+}
+
+void latency_print(bool reset)
+{
+    latency_t *lat = &_g_latency;
+    uint8_t i;
+
+    print_p("\r\nLoop gaps:\r\n\r\n");
+
+    for (i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        if (!lat->buckets[i])
+            continue;
+
+        print_p("\t>= ");
+        print_u32((uint32_t)1 << i);
+        print_p(" us\t");
+        print_u32(lat->buckets[i]);
+        print_p("\r\n");
+    }
+
+    print_p("\r\n\tworst .............: ");
+    print_u32(lat->worst_us);
+    print_p(" us (");
+
+    if (lat->worst_name[0])
+        print_str(lat->worst_name);
+    else
+        print_p("idle");
+
+    print_p(")\r\n\r\n");
+
+    if (reset)
+    {
+        memset(lat->buckets, 0, sizeof(lat->buckets));
+        lat->worst_us = 0;
+        lat->worst_name[0] = 0;
+    }
+}
@@ -0,0 +1,29 @@
+/*
+ *   File:   latency.h
+ *   Author: Matt
+ *
+ *   Created on 18 Oct 2026, 23:10
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+#define LATENCY_BUCKETS         16  /* Bucket n counts gaps of 2^n .. 2^(n+1)-1 us, the last one everything longer */
+#define LATENCY_NAME_LEN        16
+
+void latency_pass(uint32_t now);
+void latency_note(const char *name, bool progmem, uint32_t us);
+void latency_print(bool reset);
+
+#endif /* __LATENCY_H__ */
@@ -27,6 +27,8 @@
 #include <avr/io.h>
 #include <avr/pgmspace.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/crc16.h>
 
 #include "iopins.h"
 #include "config.h"
@@ -37,102 +39,321 @@
 #include "cmd.h"
 #include "util.h"
 #include "adf4350.h"
+#include "seq.h"
+#include "events.h"
+#include "task.h"
+#include "prof.h"
+#include "latency.h"
+#include "trace.h"
+#include "isrstat.h"
 
 typedef struct
 {
     sys_config_t *config;
+    bool fast_boot;
+    uint16_t rf_valid_us;
 } sys_runstate_t;
 
 sys_config_t _g_cfg;
 sys_runstate_t _g_rs;
 sys_counters_t _g_counters;
-adf4350_calculated_parameters_t _g_params;
+volatile uint8_t _g_events;
 
 FILE uart_str = FDEV_SETUP_STREAM(print_char, NULL, _FDEV_SETUP_RW);
 
 static void io_init(void);
 static void clock_init(void);
+static void get_settings(sys_config_t *config, adf4350_platform_data_t *settings);
+static uint16_t boot_hash(sys_config_t *config);
+static bool boot_restore(sys_config_t *config, boot_record_t *record);
 
 int main(void)
 {
     sys_runstate_t *rs = &_g_rs;
     sys_config_t *config = &_g_cfg;
+    boot_record_t boot;
 
     memset((void *)&_g_counters, 0x00, sizeof(sys_counters_t));
 
     rs->config = config;
 
     clock_init();
-    io_init();
     timer_tcb0_init();
+#ifdef _RTC_CALIBRATION_
+    timer_rtc_init();
+#endif
+#ifdef _PROFILE_
+    prof_init();
+#endif
+    io_init();
+
+    // Get the synthesizer going before anything else
+    load_configuration(config, &boot);
+    rs->fast_boot = boot_restore(config, &boot);
+
+    // Interrupts are still off, so CNT and a pending CAPT give the time since the timer started
+    rs->rf_valid_us = TCB0.CNT / (F_CPU / 1000000UL);
+    if (TCB0.INTFLAGS & _BV(TCB_CAPT_bp))
+        rs->rf_valid_us += 1000;
+
     g_irq_enable();
 
     usart0_open(USART_CONT_RX, USART_BAUD_RATE(UART0_BAUD)); // Console
+#ifdef _USART1_
+    usart1_open(USART_CONT_RX, USART_BAUD_RATE(UART1_BAUD)); // Machine console
+#endif
     stdout = &uart_str;
 
-    _delay_ms(500);
-    
     printf("\r\nStarting up...\r\n");
+    cmd_table_check();
+
+    if (rs->fast_boot)
+    {
+        printf("RF restored from EEPROM %u us after timer start\r\n", rs->rf_valid_us);
+    }
+    else if (do_freq(config))
+    {
+        do_save_config(config, _g_params.regs);
+    }
+
+    seq_load();
 
-    load_configuration(config);
-    do_freq(config);
+    if (config->autorun)
+        seq_start();
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
 
     // Idle loop
     for (;;)
     {
+        uint32_t pass_start;
+        uint32_t pass_us;
+
+        _g_events = 0;
+        pass_start = now_us();
+        latency_pass(pass_start);
+
         cmd_process(config);
+        task_run(config);
+
+        pass_us = now_us() - pass_start;
+
+        if (pass_us > _g_counters.stats.max_loop_us)
+            _g_counters.stats.max_loop_us = pass_us > UINT16_MAX ? UINT16_MAX : pass_us;
+
+        // Sleep unless an interrupt came in during the pass or bytes are
+        // still queued from an earlier one. sei() always runs the next
+        // instruction first, so a wake up can't be missed.
+        g_irq_disable();
+
+        if (!_g_events && !cmd_rx_pending())
+        {
+            sleep_enable();
+            g_irq_enable();
+            sleep_cpu();
+            sleep_disable();
+        }
+
+        g_irq_enable();
     }
 }
 
+static void get_settings(sys_config_t *config, adf4350_platform_data_t *settings)
+{
+    settings->clkin = 25000000;
+    settings->channel_spacing = 1000;
+    settings->max_r_value = config->r_value;
+	settings->ref_div2_en = false;
+	settings->ref_doubler_en = false;
+	settings->r2_user_settings = ADF4350_REG2_NOISE_MODE(0) | ADF4350_REG2_LDP_10ns | ADF4350_REG2_MUXOUT(0)
+		| ADF4350_REG2_PD_POLARITY_POS | ADF4350_REG2_CHARGE_PUMP_CURR_uA(2500) | ADF4350_REG2_LDF_FRACT_N;
+	settings->r3_user_settings = ADF4350_REG3_12BIT_CLKDIV(150) | ADF4350_REG3_12BIT_CLKDIV_MODE(0);
+	settings->r4_user_settings = ADF4350_REG4_OUTPUT_PWR(config->power) | (config->out_on ? ADF4350_REG4_RF_OUT_EN : 0);
+}
+
+static uint16_t boot_hash(sys_config_t *config)
+{
+    adf4350_platform_data_t settings;
+    const uint8_t *p;
+    uint16_t crc = 0xFFFF;
+    uint8_t i;
+
+    get_settings(config, &settings);
+
+    p = (const uint8_t *)&config->freq;
+    for (i = 0; i < sizeof(config->freq); i++)
+        crc = _crc16_update(crc, *p++);
+
+    p = (const uint8_t *)&settings;
+    for (i = 0; i < sizeof(settings); i++)
+        crc = _crc16_update(crc, *p++);
+
+    // 0 marks a record with no registers, so never hand it out
+    return crc ? crc : 1;
+}
+
+/*
+ * Writes the registers stored for the saved configuration, provided
+ * neither it nor the platform settings changed since they were stored.
+ */
+static bool boot_restore(sys_config_t *config, boot_record_t *record)
+{
+    uint32_t regs[ADF4350_NUM_REGS];
+
+    if (record->hash != boot_hash(config))
+        return false;
+
+    do_fixed_regs(config, regs);
+
+    regs[ADF4350_REG0] = record->r0;
+    regs[ADF4350_REG1] = record->r1;
+    regs[ADF4350_REG2] = record->r2;
+    regs[ADF4350_REG4] = record->r4;
+
+    return do_regs(regs);
+}
+
+/*
+ * Saves config to the journal along with the registers solved for it,
+ * if any, for the next power on.
+ */
+void do_save_config(sys_config_t *config, const uint32_t *regs)
+{
+    boot_record_t record;
+
+    memset(&record, 0, sizeof(boot_record_t));
+
+    if (regs)
+    {
+        record.hash = boot_hash(config);
+        record.r0 = regs[ADF4350_REG0];
+        record.r1 = regs[ADF4350_REG1];
+        record.r2 = regs[ADF4350_REG2];
+        record.r4 = regs[ADF4350_REG4];
+    }
+
+    save_configuration(config, &record);
+}
+
 bool do_freq(sys_config_t *config)
 {
     adf4350_platform_data_t settings;
 
-    settings.clkin = 25000000;
-    settings.channel_spacing = 1000;
-    settings.max_r_value = config->r_value;
-	settings.ref_div2_en = false;
-	settings.ref_doubler_en = false;
-	settings.r2_user_settings = ADF4350_REG2_NOISE_MODE(0) | ADF4350_REG2_LDP_10ns | ADF4350_REG2_MUXOUT(0)
-		| ADF4350_REG2_PD_POLARITY_POS | ADF4350_REG2_CHARGE_PUMP_CURR_uA(2500) | ADF4350_REG2_LDF_FRACT_N;
-	settings.r3_user_settings = ADF4350_REG3_12BIT_CLKDIV(150) | ADF4350_REG3_12BIT_CLKDIV_MODE(0);
-	settings.r4_user_settings = ADF4350_REG4_OUTPUT_PWR(config->power) | (config->out_on ? ADF4350_REG4_RF_OUT_EN : 0);
+    get_settings(config, &settings);
 
-    return adf4350_set_freq(config->freq * 1000 /* Hz from here on */, &settings, &_g_params);
+    return adf4350_set_freq(config->freq, &settings);
+}
+
+/*
+ * Solves freq using the rest of the current configuration, without
+ * writing anything to the synthesizer.
+ */
+bool do_solve(sys_config_t *config, uint64_t freq, uint32_t *regs)
+{
+    adf4350_platform_data_t settings;
+
+    get_settings(config, &settings);
+
+    return adf4350_calc_freq(freq, &settings, regs);
+}
+
+/*
+ * R3 and R5 as the solver would build them for config, so stored
+ * register sets always expand to the same full set.
+ */
+void do_fixed_regs(sys_config_t *config, uint32_t *regs)
+{
+    adf4350_platform_data_t settings;
+
+    get_settings(config, &settings);
+    adf4350_fixed_regs(&settings, regs);
+}
+
+/*
+ * Raw register writes, bypassing the solver.
+ */
+bool do_reg(uint8_t reg, uint32_t value)
+{
+    if (reg >= ADF4350_NUM_REGS || ADF4350_REG_ADDR(value) != reg)
+        return false;
+
+    adf4350_write_reg(value);
+
+    return true;
+}
+
+bool do_regs(const uint32_t *regs)
+{
+    uint8_t i;
+
+    for (i = 0; i < ADF4350_NUM_REGS; i++)
+    {
+        if (ADF4350_REG_ADDR(regs[i]) != i)
+            return false;
+    }
+
+    adf4350_write_regs(regs);
+
+    return true;
+}
+
+/*
+ * Actual output frequency in Hz, decoded from the registers last written.
+ */
+uint64_t do_actual_freq(void)
+{
+    uint32_t regs[ADF4350_NUM_REGS];
+    adf4350_platform_data_t settings;
+
+    get_settings(_g_rs.config, &settings);
+    adf4350_get_regs(regs);
+
+    return adf4350_actual_freq(settings.clkin, regs);
 }
 
 void do_state(void)
 {
-    adf4350_calculated_parameters_t *params = &_g_params;
-
-    printf("\r\nCalculated state:\r\n\r\n"
-           "\tActual frequency ..: %lu.%lu MHz\r\n"
-           "\tVCO ...............: %lu.%lu MHz\r\n"
-           "\tPFD ...............: %lu.%lu MHz\r\n"
-           "\tREF_DIV ...........: %d\r\n"
-           "\tR0_INT ............: %d\r\n"
-           "\tR0_FRACT ..........: %d\r\n"
-           "\tR1_MOD ............: %d\r\n"
-           "\tRF_DIV ............: %d\r\n"
-           "\tPRESCALER .........: %s\r\n"
-           "\tBAND_SEL_DIV ......: %d\r\n"
-           "\tR0 ................: 0x%08lX\r\n"
-           "\tR1 ................: 0x%08lX\r\n"
-           "\tR2 ................: 0x%08lX\r\n"
-           "\tR3 ................: 0x%08lX\r\n"
-           "\tR4 ................: 0x%08lX\r\n"
-           "\tR5 ................: 0x%08lX\r\n\r\n"
-           "Lock detect: %s\r\n\r\n",
-		(uint32_t)(params->actual_freq / 1000000), (uint32_t)(params->actual_freq % 1000000),
-        (uint32_t)(params->vco / 1000000), (uint32_t)(params->vco % 1000000),
-        (uint32_t)(params->pfd / 1000000), (uint32_t)(params->pfd % 1000000),
-        params->r_cnt, params->intv,
-        params->fract, params->mod, params->rf_div,
-        params->prescaler ? "8/9" : "4/5",
-        params->band_sel_div,
-        params->regs[0], params->regs[1], params->regs[2],
-        params->regs[3], params->regs[4], params->regs[5],
-        IO_IN_HIGH(LD) ? "on" : "off");
+    uint32_t regs[ADF4350_NUM_REGS];
+    adf4350_platform_data_t settings;
+    uint8_t i;
+
+    get_settings(_g_rs.config, &settings);
+    adf4350_get_regs(regs);
+
+    print_p("\r\nCalculated state:\r\n\r\n\tActual frequency ..: ");
+    print_u64_dp(adf4350_actual_freq(settings.clkin, regs), 6);
+    print_p(" MHz\r\n\tVCO ...............: ");
+    print_u64_dp(adf4350_vco(settings.clkin, regs), 6);
+    print_p(" MHz\r\n\tPFD ...............: ");
+    print_u64_dp(adf4350_pfd(settings.clkin, regs), 6);
+    print_p(" MHz\r\n\tREF_DIV ...........: ");
+    print_u32(adf4350_r_cnt(regs));
+    print_p("\r\n\tR0_INT ............: ");
+    print_u32(adf4350_intv(regs));
+    print_p("\r\n\tR0_FRACT ..........: ");
+    print_u32(adf4350_fract(regs));
+    print_p("\r\n\tR1_MOD ............: ");
+    print_u32(adf4350_mod(regs));
+    print_p("\r\n\tRF_DIV ............: ");
+    print_u32(adf4350_rf_div(regs));
+    print_p("\r\n\tPRESCALER .........: ");
+    print_pstr(adf4350_prescaler(regs) ? PSTR("8/9") : PSTR("4/5"));
+    print_p("\r\n\tBAND_SEL_DIV ......: ");
+    print_u32(adf4350_band_sel_div(regs));
+    print_p("\r\n");
+
+    for (i = 0; i < 6; i++)
+    {
+        print_p("\tR");
+        putch('0' + i);
+        print_p(" ................: 0x");
+        print_hex32(regs[i]);
+        print_p("\r\n");
+    }
+
+    print_p("\r\nLock detect: ");
+    print_pstr(IO_IN_HIGH(LD) ? PSTR("on") : PSTR("off"));
+    print_p("\r\n\r\n");
 }
 
 static void clock_init(void)
@@ -143,6 +364,7 @@ static void clock_init(void)
 static void io_init(void)
 {
     IO_INPUT(LD);
+    LD_PINCTRL = PORT_ISC_BOTHEDGES_gc;
     IO_LOW(LE);
     IO_LOW(CLOCK);
     IO_LOW(DATA);
@@ -152,9 +374,28 @@ static void io_init(void)
     IO_OUTPUT(CLOCK);
 }
 
+ISR(PORTA_PORT_vect)
+{
+    ISRSTAT_BEGIN(ISRSTAT_PORTA);
+
+    if (LD_INTFLAGS & _BV(LD))
+    {
+        if (IO_IN_LOW(LD))
+            _g_counters.stats.unlock_events++;
+
+        TRACE(TRACE_LD_EDGE, IO_IN_HIGH(LD));
+
+        LD_INTFLAGS = _BV(LD);
+        event_post(EV_LD);
+    }
+
+    ISRSTAT_END(ISRSTAT_PORTA);
+}
+
 int print_char(char byte, FILE *stream)
 {
-    while (console_busy());
-    console_put(byte);
+    PROF_BEGIN(PROF_PRINT_CHAR);
+    putch(byte);
+    PROF_END(PROF_PRINT_CHAR);
     return 0;
 }
\ No newline at end of file
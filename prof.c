@@ -0,0 +1,130 @@
+/*
+ *   File:   prof.c
+ *   Author: Matt
+ *
+ *   Created on 18 Oct 2026, 21:50
+ *
+ *   Cycle counting probes, built with _PROFILE_ only. Times include any
+ *   interrupts taken inside the probe.
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#ifdef _PROFILE_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "prof.h"
+#include "timer.h"
+#include "util.h"
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t total;
+    uint32_t min;
+    uint32_t max;
+} prof_probe_t;
+
+static void prof_reset(void);
+
+static const char _g_prof_calc[] PROGMEM = "calc";
+static const char _g_prof_write[] PROGMEM = "write";
+static const char _g_prof_reg[] PROGMEM = "reg word";
+static const char _g_prof_cmd[] PROGMEM = "command";
+static const char _g_prof_print[] PROGMEM = "putchar";
+
+static const char * const _g_prof_names[PROF_PROBES] PROGMEM =
+{
+    _g_prof_calc,
+    _g_prof_write,
+    _g_prof_reg,
+    _g_prof_cmd,
+    _g_prof_print
+};
+
+static prof_probe_t _g_probes[PROF_PROBES];
+static uint16_t _g_prof_overhead; /* Cycles an empty probe measures */
+
+void prof_init(void)
+{
+    PROF_BEGIN(PROF_COMMAND);
+    _g_prof_overhead = now_cycles() - _prof_PROF_COMMAND;
+
+    prof_reset();
+}
+
+/*
+ * May be called from interrupt context (register writes from the retune
+ * queue), hence the atomic block.
+ */
+void prof_record(uint8_t probe, uint32_t cycles)
+{
+    prof_probe_t *p = &_g_probes[probe];
+
+    cycles = cycles > _g_prof_overhead ? cycles - _g_prof_overhead : 0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        p->count++;
+        p->total += cycles;
+
+        if (cycles < p->min)
+            p->min = cycles;
+
+        if (cycles > p->max)
+            p->max = cycles;
+    }
+}
+
+void prof_print_reset(void)
+{
+    prof_probe_t probes[PROF_PROBES];
+    uint8_t i;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memcpy(probes, _g_probes, sizeof(probes));
+        prof_reset();
+    }
+
+    print_p("\r\nProfile (cycles):\r\n\r\n\tprobe      count      total        min        max\r\n");
+
+    for (i = 0; i < PROF_PROBES; i++)
+    {
+        prof_probe_t *p = &probes[i];
+
+        printf("\t%-10S %-10lu %-12lu %-10lu %lu\r\n", pgm_read_ptr(&_g_prof_names[i]),
+            p->count, p->total, p->count ? p->min : 0, p->max);
+    }
+
+    print_p("\r\n");
+}
+
+static void prof_reset(void)
+{
+    uint8_t i;
+
+    memset(_g_probes, 0, sizeof(_g_probes));
+
+    for (i = 0; i < PROF_PROBES; i++)
+        _g_probes[i].min = UINT32_MAX;
+}
+
+#endif /* _PROFILE_ */
@@ -0,0 +1,47 @@
+/*
+ *   File:   prof.h
+ *   Author: Matt
+ *
+ *   Created on 18 Oct 2026, 21:50
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PROF_H__
+#define __PROF_H__
+
+#define PROF_SET_FREQ_CALC      0
+#define PROF_SET_FREQ_WRITE     1
+#define PROF_REG_WORD           2
+#define PROF_COMMAND            3
+#define PROF_PRINT_CHAR         4
+#define PROF_PROBES             5
+
+#ifdef _PROFILE_
+
+#include "timer.h"
+
+#define PROF_BEGIN(probe)       uint32_t _prof_##probe = now_cycles()
+#define PROF_END(probe)         prof_record(probe, now_cycles() - _prof_##probe)
+
+void prof_init(void);
+void prof_record(uint8_t probe, uint32_t cycles);
+void prof_print_reset(void);
+
+#else
+
+#define PROF_BEGIN(probe)
+#define PROF_END(probe)
+
+#endif /* _PROFILE_ */
+
+#endif /* __PROF_H__ */
@@ -20,10 +20,10 @@
 #ifndef __PROJECT_H__
 #define __PROJECT_H__
 
-#define _I2C_XFER_
+//#define _I2C_XFER_ /* i2c.c is not built */
 
-#define CONFIG_MAGIC        0x4144
-#define DEFAULT_FREQ        200000
+#define CONFIG_MAGIC        0x4146
+#define DEFAULT_FREQ        200000000ULL /* Hz */
 #define DEFAULT_R           0
 #define DEFAULT_POWER       3
 
@@ -33,8 +33,32 @@
 #define g_irq_enable sei
 
 #define UART0_BAUD           9600
+#define UART1_BAUD           115200
 
 #define _USART0_
+#define _USART1_
+
+// Trims the 1 ms tick against a 32.768 kHz reference clock fed to PA3
+// (RTC EXTCLK). A crystal on TOSC1/TOSC2 would need PB2/PB3, which are
+// USART0 TX/RX, so is not supported.
+//#define _RTC_CALIBRATION_
+
+// Cycle counting probes and the 'perf' command
+//#define _PROFILE_
+
+// us-stamped event trace and the 'trace' command. Each entry is 6 bytes
+// of SRAM, so 32 entries fit beside the command and USART buffers.
+//#define _TRACE_
+#define TRACE_SIZE          32  /* Power of 2, at most 128 */
+
+// Per-interrupt max duration (and TCB0 latency) and the 'isr' command
+//#define _ISR_STATS_
+
+// Runs TCB0 at interrupt level 1 so the tick and retune queue are never
+// held off by USART or port handlers. A queued retune is then shifted out
+// at level 1 too (about 20 us per changed word, plus R0), blocking every
+// other vector for that long.
+//#define _TCB0_LVL1_
 
 #define console_busy         usart0_busy
 #define console_put          usart0_put
@@ -42,4 +66,9 @@
 #define console_get          usart0_get
 #define console_clear_oerr   usart0_clear_oerr
 
+#define console2_busy        usart1_busy
+#define console2_put         usart1_put
+#define console2_data_ready  usart1_data_ready
+#define console2_get         usart1_get
+
 #endif /* __PROJECT_H__ */
\ No newline at end of file
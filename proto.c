@@ -0,0 +1,228 @@
+/*
+ *   File:   proto.c
+ *   Author: Matt
+ *
+ *   Created on 18 Oct 2026, 10:12
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/io.h>
+
+#include "iopins.h"
+#include "config.h"
+#include "cmd.h"
+#include "proto.h"
+#include "util.h"
+#include "timer.h"
+#include "adf4350.h"
+#include "retune.h"
+#include "counters.h"
+
+/*
+ * 'frame' holds op, len, payload and sum (SOH already stripped),
+ * 'len' is the number of bytes received.
+ */
+void proto_handle(const uint8_t *frame, uint8_t len, sys_config_t *config)
+{
+    uint8_t op = frame[0];
+    uint8_t plen = frame[1];
+    uint8_t sum = 0;
+    uint8_t i;
+
+    if (plen > PROTO_MAX_PAYLOAD || len != plen + PROTO_HEADER_LEN + 1)
+    {
+        proto_reply(op, PROTO_ERR_LEN, NULL, 0);
+        return;
+    }
+
+    for (i = 0; i < len; i++)
+        sum += frame[i];
+
+    if (sum)
+    {
+        proto_reply(op, PROTO_ERR_CHECKSUM, NULL, 0);
+        return;
+    }
+
+    _g_counters.stats.commands++;
+
+    switch (op)
+    {
+        case PROTO_OP_LOCK:
+        {
+            uint8_t lock = IO_IN_HIGH(LD);
+            proto_reply(op, PROTO_OK, &lock, sizeof(lock));
+            break;
+        }
+        case PROTO_OP_FREQ:
+        {
+            uint64_t freq = do_actual_freq();
+            proto_reply(op, PROTO_OK, &freq, sizeof(freq));
+            break;
+        }
+        case PROTO_OP_REGS:
+        {
+            uint32_t regs[ADF4350_NUM_REGS];
+
+            adf4350_get_regs(regs);
+            proto_reply(op, PROTO_OK, regs, sizeof(regs));
+            break;
+        }
+        case PROTO_OP_STATUS:
+        {
+            proto_status_t status;
+
+            status.tick_count = timer_get_ticks();
+            status.actual_freq = do_actual_freq();
+            status.lock = IO_IN_HIGH(LD);
+            proto_reply(op, PROTO_OK, &status, sizeof(status));
+            break;
+        }
+        case PROTO_OP_STREAM:
+        {
+            uint16_t period;
+
+            if (plen != sizeof(period))
+            {
+                proto_reply(op, PROTO_ERR_LEN, NULL, 0);
+                break;
+            }
+
+            period = frame[2] | (frame[3] << 8);
+
+            if (!cmd_stream_start(period, true))
+            {
+                proto_reply(op, PROTO_ERR_FAILED, NULL, 0);
+                break;
+            }
+
+            proto_reply(op, PROTO_OK, NULL, 0);
+            break;
+        }
+        case PROTO_OP_WRITE_REG:
+        {
+            uint32_t value;
+
+            if (plen != 1 + sizeof(value))
+            {
+                proto_reply(op, PROTO_ERR_LEN, NULL, 0);
+                break;
+            }
+
+            memcpy(&value, &frame[3], sizeof(value));
+            proto_reply(op, do_reg(frame[2], value) ? PROTO_OK : PROTO_ERR_FAILED, NULL, 0);
+            break;
+        }
+        case PROTO_OP_WRITE_REGS:
+        {
+            uint32_t regs[ADF4350_NUM_REGS];
+
+            if (plen != sizeof(regs))
+            {
+                proto_reply(op, PROTO_ERR_LEN, NULL, 0);
+                break;
+            }
+
+            memcpy(regs, &frame[2], sizeof(regs));
+            proto_reply(op, do_regs(regs) ? PROTO_OK : PROTO_ERR_FAILED, NULL, 0);
+            break;
+        }
+        case PROTO_OP_AT_FREQ:
+        case PROTO_OP_AT_REGS:
+        {
+            uint32_t regs[ADF4350_NUM_REGS];
+            int32_t tick;
+            bool ret = true;
+
+            if (plen != sizeof(tick) + (op == PROTO_OP_AT_FREQ ? sizeof(uint64_t) : sizeof(regs)))
+            {
+                proto_reply(op, PROTO_ERR_LEN, NULL, 0);
+                break;
+            }
+
+            memcpy(&tick, &frame[2], sizeof(tick));
+
+            if (op == PROTO_OP_AT_FREQ)
+            {
+                uint64_t freq;
+
+                memcpy(&freq, &frame[2 + sizeof(tick)], sizeof(freq));
+                ret = do_solve(config, freq, regs);
+            }
+            else
+            {
+                uint8_t i;
+
+                memcpy(regs, &frame[2 + sizeof(tick)], sizeof(regs));
+
+                for (i = 0; i < ADF4350_NUM_REGS; i++)
+                {
+                    if (ADF4350_REG_ADDR(regs[i]) != i)
+                        ret = false;
+                }
+            }
+
+            ret = ret && retune_queue_add(tick, regs);
+            proto_reply(op, ret ? PROTO_OK : PROTO_ERR_FAILED, NULL, 0);
+            break;
+        }
+        case PROTO_OP_STATS:
+        {
+            sys_stats_t stats;
+
+            if (plen > 1)
+            {
+                proto_reply(op, PROTO_ERR_LEN, NULL, 0);
+                break;
+            }
+
+            stats_read(&stats, plen && frame[2]);
+            proto_reply(op, PROTO_OK, &stats, sizeof(stats));
+            break;
+        }
+        default:
+            proto_reply(op, PROTO_ERR_OP, NULL, 0);
+            break;
+    }
+}
+
+void proto_reply(uint8_t op, uint8_t status, const void *payload, uint8_t len)
+{
+    const uint8_t *p = (const uint8_t *)payload;
+    uint8_t sum;
+
+    if (status != PROTO_OK)
+        _g_counters.stats.command_failures++;
+
+    op |= PROTO_REPLY;
+    sum = op + status + len;
+
+    putch(PROTO_SOH);
+    putch(op);
+    putch(status);
+    putch(len);
+
+    while (len--)
+    {
+        sum += *p;
+        putch(*p++);
+    }
+
+    putch(-sum);
+}
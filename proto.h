@@ -0,0 +1,78 @@
+/*
+ *   File:   proto.h
+ *   Author: Matt
+ *
+ *   Created on 18 Oct 2026, 10:12
+ *
+ *   Compact binary protocol for host automation.
+ *
+ *   Request:  SOH op len payload[len] sum
+ *   Response: SOH op|0x80 status len payload[len] sum
+ *
+ *   'sum' is chosen so that all bytes after SOH add up to zero (mod 256).
+ *   A request is only recognised at the start of an empty console line.
+ *   Multi-byte values are little endian.
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PROTO_H__
+#define __PROTO_H__
+
+#define PROTO_SOH               0x01
+#define PROTO_REPLY             0x80
+#define PROTO_HEADER_LEN        2    /* op, len */
+#define PROTO_MAX_PAYLOAD       (CMD_MAX_LINE - PROTO_HEADER_LEN - 1)
+#define PROTO_TIMEOUT_MS        100
+
+/* Opcodes */
+#define PROTO_OP_LOCK           0x01 /* -> u8 lock detect */
+#define PROTO_OP_FREQ           0x02 /* -> u64 actual frequency in Hz */
+#define PROTO_OP_REGS           0x03 /* -> u32 R0..R5 */
+#define PROTO_OP_STATUS         0x04 /* -> proto_status_t */
+#define PROTO_OP_STREAM         0x05 /* u16 period in ms (0 = stop) -> */
+#define PROTO_OP_TELEMETRY      0x06 /* Unsolicited, proto_telemetry_t */
+#define PROTO_OP_WRITE_REG      0x07 /* u8 n, u32 word -> */
+#define PROTO_OP_WRITE_REGS     0x08 /* u32 R0..R5 (written R5 first) -> */
+#define PROTO_OP_AT_FREQ        0x09 /* i32 tick, u64 freq in Hz -> */
+#define PROTO_OP_AT_REGS        0x0A /* i32 tick, u32 R0..R5 -> */
+#define PROTO_OP_STATS          0x0B /* [u8 1 = reset after reading] -> sys_stats_t */
+
+/* Status codes */
+#define PROTO_OK                0x00
+#define PROTO_ERR_CHECKSUM      0x01
+#define PROTO_ERR_OP            0x02
+#define PROTO_ERR_LEN           0x03
+#define PROTO_ERR_FAILED        0x04
+
+typedef struct
+{
+    int32_t tick_count;
+    uint64_t actual_freq;
+    uint8_t lock;
+} proto_status_t;
+
+typedef struct
+{
+    int32_t tick_count;
+    uint8_t lock;
+    uint8_t freq_index;
+    uint16_t unlock_events;
+    uint16_t uart_errors;
+    uint16_t command_failures;
+    uint16_t solves;
+} proto_telemetry_t;
+
+void proto_handle(const uint8_t *frame, uint8_t len, sys_config_t *config);
+void proto_reply(uint8_t op, uint8_t status, const void *payload, uint8_t len);
+
+#endif /* __PROTO_H__ */
@@ -0,0 +1,145 @@
+/*
+ *   File:   retune.c
+ *   Author: Matt
+ *
+ *   Created on 18 Oct 2026, 14:40
+ *
+ *   Time ordered queue of pre-solved register sets, committed to the
+ *   synthesizer from the TCB0 tick interrupt when their tick comes up.
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "retune.h"
+#include "adf4350.h"
+
+typedef struct
+{
+    int32_t tick;
+    uint32_t regs[ADF4350_NUM_REGS];
+} retune_t;
+
+static retune_t _g_retune_queue[RETUNE_QUEUE_SIZE];
+static volatile uint8_t _g_retune_count;
+
+bool retune_queue_add(int32_t tick, const uint32_t *regs)
+{
+    bool ret = false;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        uint8_t count = _g_retune_count;
+        uint8_t i = count;
+
+        if (count < RETUNE_QUEUE_SIZE)
+        {
+            // Insertion sort, entries with the same tick keep their order
+            while (i > 0 && _g_retune_queue[i - 1].tick - tick > 0)
+            {
+                _g_retune_queue[i] = _g_retune_queue[i - 1];
+                i--;
+            }
+
+            _g_retune_queue[i].tick = tick;
+            memcpy(_g_retune_queue[i].regs, regs, sizeof(_g_retune_queue[i].regs));
+            _g_retune_count = count + 1;
+            ret = true;
+        }
+    }
+
+    return ret;
+}
+
+bool retune_queue_get(uint8_t idx, int32_t *tick, uint32_t *r0)
+{
+    bool ret = false;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (idx < _g_retune_count)
+        {
+            *tick = _g_retune_queue[idx].tick;
+            *r0 = _g_retune_queue[idx].regs[ADF4350_REG0];
+            ret = true;
+        }
+    }
+
+    return ret;
+}
+
+uint8_t retune_queue_count(void)
+{
+    return _g_retune_count;
+}
+
+void retune_queue_clear(void)
+{
+    _g_retune_count = 0;
+}
+
+/*
+ * Drops the first entry due at tick with the given R0, if it has not
+ * been committed yet. Entries queued by 'at' for the same tick normally
+ * differ in R0, so they are left alone.
+ */
+bool retune_queue_remove(int32_t tick, uint32_t r0)
+{
+    bool ret = false;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        uint8_t count = _g_retune_count;
+        uint8_t i;
+
+        for (i = 0; i < count; i++)
+        {
+            if (_g_retune_queue[i].tick == tick && _g_retune_queue[i].regs[ADF4350_REG0] == r0)
+            {
+                count--;
+                memmove(&_g_retune_queue[i], &_g_retune_queue[i + 1], (count - i) * sizeof(retune_t));
+                _g_retune_count = count;
+                ret = true;
+                break;
+            }
+        }
+    }
+
+    return ret;
+}
+
+/*
+ * Called from TCB0_INT_vect. At most one set is committed per tick. If the
+ * main context is in the middle of a register write the commit slips to
+ * the next tick.
+ */
+void retune_queue_service(int32_t tick)
+{
+    uint8_t count = _g_retune_count;
+
+    if (!count || tick - _g_retune_queue[0].tick < 0)
+        return;
+
+    if (!adf4350_write_regs_isr(_g_retune_queue[0].regs))
+        return;
+
+    count--;
+    memmove(&_g_retune_queue[0], &_g_retune_queue[1], count * sizeof(retune_t));
+    _g_retune_count = count;
+}
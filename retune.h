@@ -0,0 +1,31 @@
+/*
+ *   File:   retune.h
+ *   Author: Matt
+ *
+ *   Created on 18 Oct 2026, 14:40
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RETUNE_H__
+#define __RETUNE_H__
+
+#define RETUNE_QUEUE_SIZE       4
+
+bool retune_queue_add(int32_t tick, const uint32_t *regs);
+bool retune_queue_get(uint8_t idx, int32_t *tick, uint32_t *r0);
+uint8_t retune_queue_count(void);
+void retune_queue_clear(void);
+bool retune_queue_remove(int32_t tick, uint32_t r0);
+void retune_queue_service(int32_t tick);
+
+#endif /* __RETUNE_H__ */
@@ -0,0 +1,276 @@
+/*
+ *   File:   seq.c
+ *   Author: Matt
+ *
+ *   Created on 18 Oct 2026, 16:05
+ *
+ *   Hop list / sweep sequencer. Steps are handed to the retune queue one
+ *   step ahead so that they are committed on the tick from the timer ISR.
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "config.h"
+#include "cmd.h"
+#include "seq.h"
+#include "util.h"
+#include "timer.h"
+#include "retune.h"
+#include "counters.h"
+#include "adf4350.h"
+#include "task.h"
+
+typedef struct
+{
+    bool running;
+    bool queued;
+    uint32_t queued_r0;     /* Identifies our entry in the retune queue */
+    int8_t task;
+    uint16_t index;
+    int32_t next_tick;
+} seq_runstate_t;
+
+static seq_def_t _g_seq;
+static seq_runstate_t _g_seq_rs;
+
+static uint16_t seq_length(void);
+static void seq_task(sys_config_t *config, uint8_t arg);
+
+static const char _g_task_seq[] PROGMEM = "seq";
+
+void seq_clear(void)
+{
+    seq_stop();
+    memset(&_g_seq, 0, sizeof(seq_def_t));
+    _g_seq.dwell = SEQ_DEFAULT_DWELL;
+}
+
+bool seq_add_hop(const uint32_t *regs)
+{
+    seq_hop_t *hop;
+
+    if (_g_seq.mode != SEQ_HOP)
+    {
+        // hop.r2 shares the union with the sweep, so stop using it first
+        seq_stop();
+        _g_seq.mode = SEQ_HOP;
+        _g_seq.count = 0;
+    }
+
+    if (_g_seq.count >= SEQ_MAX_HOPS)
+        return false;
+
+    if (!_g_seq.count)
+        _g_seq.hop.r2 = regs[ADF4350_REG2];
+    else if (_g_seq.hop.r2 != regs[ADF4350_REG2])
+        return false; /* Needs a different R counter */
+
+    hop = &_g_seq.hop.hops[_g_seq.count++];
+    hop->r0 = regs[ADF4350_REG0];
+    hop->r1 = regs[ADF4350_REG1];
+    hop->r4 = regs[ADF4350_REG4];
+
+    return true;
+}
+
+void seq_set_sweep(uint64_t start, int32_t step, uint16_t steps)
+{
+    seq_stop();
+    _g_seq.mode = SEQ_SWEEP;
+    _g_seq.sweep.start = start;
+    _g_seq.sweep.step = step;
+    _g_seq.sweep.steps = steps;
+}
+
+void seq_set_dwell(uint16_t dwell)
+{
+    _g_seq.dwell = dwell;
+
+    if (_g_seq_rs.running)
+        task_set_period(_g_seq_rs.task, dwell);
+}
+
+bool seq_start(void)
+{
+    if (!seq_length() || !_g_seq.dwell)
+        return false;
+
+    seq_stop();
+
+    _g_seq_rs.index = 0;
+    _g_seq_rs.queued = false;
+    _g_seq_rs.next_tick = timer_get_ticks() + 1;
+    _g_seq_rs.task = task_add(_g_task_seq, seq_task, 0, _g_seq.dwell, _g_seq_rs.next_tick - 1);
+    _g_seq_rs.running = (_g_seq_rs.task != TASK_NONE);
+
+    return _g_seq_rs.running;
+}
+
+void seq_stop(void)
+{
+    if (_g_seq_rs.running)
+    {
+        task_remove(_g_seq_rs.task);
+
+        // Don't let the step already queued land after the stop
+        if (_g_seq_rs.queued)
+            retune_queue_remove(_g_seq_rs.next_tick, _g_seq_rs.queued_r0);
+    }
+
+    _g_seq_rs.running = false;
+    _g_seq_rs.queued = false;
+}
+
+_Static_assert(sizeof(seq_def_t) <= EEPROM_SEQ_SIZE, "seq_def_t does not fit EEPROM_SEQ_SIZE");
+
+void seq_save(void)
+{
+    eeprom_write_data(EEPROM_SEQ_ADDR, (uint8_t *)&_g_seq, sizeof(seq_def_t));
+}
+
+void seq_load(void)
+{
+    eeprom_read_data(EEPROM_SEQ_ADDR, (uint8_t *)&_g_seq, sizeof(seq_def_t));
+
+    if (_g_seq.mode > SEQ_SWEEP || _g_seq.count > SEQ_MAX_HOPS)
+        seq_clear();
+}
+
+void seq_print(void)
+{
+    uint8_t i;
+
+    print_p("\r\nSequence:\r\n\r\n\tmode ..............: ");
+
+    if (_g_seq.mode == SEQ_HOP)
+        print_p("hop");
+    else if (_g_seq.mode == SEQ_SWEEP)
+        print_p("sweep");
+    else
+        print_p("none");
+
+    print_p("\r\n\tdwell .............: ");
+    print_u32(_g_seq.dwell);
+    print_p(" ms\r\n\tstate .............: ");
+    print_pstr(_g_seq_rs.running ? PSTR("running") : PSTR("stopped"));
+    print_p("\r\n");
+
+    if (_g_seq.mode == SEQ_HOP)
+    {
+        print_p("\tR2 ................: 0x");
+        print_hex32(_g_seq.hop.r2);
+        print_p("\r\n");
+
+        for (i = 0; i < _g_seq.count; i++)
+        {
+            print_p("\t");
+            print_u32(i);
+            print_p(" .................: 0x");
+            print_hex32(_g_seq.hop.hops[i].r0);
+            print_p(" 0x");
+            print_hex32(_g_seq.hop.hops[i].r1);
+            print_p(" 0x");
+            print_hex32(_g_seq.hop.hops[i].r4);
+            print_p("\r\n");
+        }
+    }
+    else if (_g_seq.mode == SEQ_SWEEP)
+    {
+        print_p("\tstart .............: ");
+        print_u64_dp(_g_seq.sweep.start, 6);
+        print_p(" MHz\r\n\tstep ..............: ");
+
+        if (_g_seq.sweep.step < 0)
+            putch('-');
+
+        print_u64_dp(_g_seq.sweep.step < 0 ? -(int64_t)_g_seq.sweep.step : _g_seq.sweep.step, 6);
+        print_p(" MHz\r\n\tsteps .............: ");
+        print_u32(_g_seq.sweep.steps);
+        print_p("\r\n");
+    }
+
+    print_p("\r\n");
+}
+
+static uint16_t seq_length(void)
+{
+    if (_g_seq.mode == SEQ_HOP)
+        return _g_seq.count;
+    if (_g_seq.mode == SEQ_SWEEP)
+        return _g_seq.sweep.steps;
+    return 0;
+}
+
+static bool seq_build(sys_config_t *config, uint16_t index, uint32_t *regs)
+{
+    if (_g_seq.mode == SEQ_HOP)
+    {
+        const seq_hop_t *hop = &_g_seq.hop.hops[index];
+
+        do_fixed_regs(config, regs);
+        regs[ADF4350_REG0] = hop->r0;
+        regs[ADF4350_REG1] = hop->r1;
+        regs[ADF4350_REG2] = _g_seq.hop.r2;
+        regs[ADF4350_REG4] = hop->r4;
+
+        return true;
+    }
+
+    return do_solve(config, _g_seq.sweep.start + (int64_t)_g_seq.sweep.step * index, regs);
+}
+
+/*
+ * Runs once per dwell. Keeps the next step in the retune queue and
+ * advances once its tick has passed, so each step is queued a whole
+ * dwell ahead of when it is committed.
+ */
+static void seq_task(sys_config_t *config, uint8_t arg)
+{
+    uint32_t regs[ADF4350_NUM_REGS];
+    int32_t now;
+
+    now = timer_get_ticks();
+
+    if (_g_seq_rs.queued && now - _g_seq_rs.next_tick >= 0)
+    {
+        _g_counters.freq_index = _g_seq_rs.index;
+
+        if (++_g_seq_rs.index >= seq_length())
+            _g_seq_rs.index = 0;
+
+        _g_seq_rs.next_tick += _g_seq.dwell;
+        _g_seq_rs.queued = false;
+
+        if (now - _g_seq_rs.next_tick >= 0) /* Fell behind */
+            _g_seq_rs.next_tick = now + 1;
+    }
+
+    if (!_g_seq_rs.queued)
+    {
+        if (!seq_build(config, _g_seq_rs.index, regs))
+        {
+            seq_stop();
+            return;
+        }
+
+        _g_seq_rs.queued = retune_queue_add(_g_seq_rs.next_tick, regs);
+        _g_seq_rs.queued_r0 = regs[ADF4350_REG0];
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ *   File:   seq.h
+ *   Author: Matt
+ *
+ *   Created on 18 Oct 2026, 16:05
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SEQ_H__
+#define __SEQ_H__
+
+#define SEQ_NONE                0
+#define SEQ_HOP                 1
+#define SEQ_SWEEP               2
+
+#define SEQ_MAX_HOPS            6
+#define SEQ_DEFAULT_DWELL       100 /* ms */
+
+/*
+ * Hops are stored pre-solved. R3 and R5 only depend on the platform
+ * settings and all hops must share the same R2 (R counter), so only
+ * R0, R1 and R4 are kept per hop.
+ */
+typedef struct
+{
+    uint32_t r0;
+    uint32_t r1;
+    uint32_t r4;
+} seq_hop_t;
+
+typedef struct
+{
+    uint8_t mode;
+    uint8_t count;   /* Number of hops */
+    uint16_t dwell;  /* ms per step */
+    union
+    {
+        struct
+        {
+            uint32_t r2;
+            seq_hop_t hops[SEQ_MAX_HOPS];
+        } hop;
+        struct
+        {
+            uint64_t start; /* Hz */
+            int32_t step;   /* Hz */
+            uint16_t steps;
+        } sweep;
+    };
+} seq_def_t;
+
+void seq_clear(void);
+bool seq_add_hop(const uint32_t *regs);
+void seq_set_sweep(uint64_t start, int32_t step, uint16_t steps);
+void seq_set_dwell(uint16_t dwell);
+bool seq_start(void);
+void seq_stop(void);
+void seq_save(void);
+void seq_load(void);
+void seq_print(void);
+
+#endif /* __SEQ_H__ */
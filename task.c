@@ -0,0 +1,142 @@
+/*
+ *   File:   task.c
+ *   Author: Matt
+ *
+ *   Created on 18 Oct 2026, 20:30
+ *
+ *   Cooperative scheduler for periodic work, run from the idle loop off
+ *   the 1 ms tick. Handlers run to completion and must not block.
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "config.h"
+#include "task.h"
+#include "timer.h"
+#include "util.h"
+#include "latency.h"
+
+typedef struct
+{
+    const char *name;       /* PROGMEM */
+    task_handler_t handler; /* NULL = free slot */
+    uint8_t arg;
+    uint16_t period;        /* ms */
+    int32_t deadline;       /* tick */
+    timed_section_t run;
+    uint16_t overruns;      /* Deadlines missed by a whole period or more */
+} task_t;
+
+static task_t _g_tasks[TASK_MAX];
+
+int8_t task_add(const char *name, task_handler_t handler, uint8_t arg, uint16_t period, int32_t first)
+{
+    int8_t i;
+
+    if (!period)
+        return TASK_NONE;
+
+    for (i = 0; i < TASK_MAX; i++)
+    {
+        task_t *task = &_g_tasks[i];
+
+        if (task->handler)
+            continue;
+
+        memset(task, 0, sizeof(task_t));
+        task->name = name;
+        task->arg = arg;
+        task->period = period;
+        task->deadline = first;
+        task->handler = handler;
+
+        return i;
+    }
+
+    return TASK_NONE;
+}
+
+void task_remove(int8_t slot)
+{
+    if (slot >= 0 && slot < TASK_MAX)
+        _g_tasks[slot].handler = NULL;
+}
+
+void task_set_period(int8_t slot, uint16_t period)
+{
+    if (slot >= 0 && slot < TASK_MAX && period)
+        _g_tasks[slot].period = period;
+}
+
+/*
+ * Runs every task whose deadline has passed, once. A task that has
+ * fallen a whole period behind is counted as overrun and rescheduled
+ * from now rather than run repeatedly to catch up.
+ */
+void task_run(sys_config_t *config)
+{
+    uint8_t i;
+
+    for (i = 0; i < TASK_MAX; i++)
+    {
+        task_t *task = &_g_tasks[i];
+        int32_t start;
+
+        if (!task->handler)
+            continue;
+
+        start = timer_get_ticks();
+
+        if (start - task->deadline < 0)
+            continue;
+
+        task->deadline += task->period;
+
+        if (start - task->deadline >= 0)
+        {
+            task->overruns++;
+            task->deadline = start + task->period;
+        }
+
+        timed_section_begin(&task->run);
+        task->handler(config, task->arg);
+        latency_note(task->name, true, timed_section_end(&task->run));
+    }
+}
+
+void task_print(void)
+{
+    uint8_t i;
+
+    print_p("\r\nTasks:\r\n\r\n\tname     period   runs       total us   max us   overruns\r\n");
+
+    for (i = 0; i < TASK_MAX; i++)
+    {
+        task_t *task = &_g_tasks[i];
+
+        if (!task->handler)
+            continue;
+
+        printf("\t%-8S %-8u %-10lu %-10lu %-8lu %u\r\n", task->name, task->period,
+            task->run.count, task->run.total, task->run.max, task->overruns);
+    }
+
+    print_p("\r\n");
+}
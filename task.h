@@ -0,0 +1,33 @@
+/*
+ *   File:   task.h
+ *   Author: Matt
+ *
+ *   Created on 18 Oct 2026, 20:30
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TASK_H__
+#define __TASK_H__
+
+#define TASK_MAX                4
+#define TASK_NONE               (-1)
+
+typedef void (*task_handler_t)(sys_config_t *config, uint8_t arg);
+
+int8_t task_add(const char *name, task_handler_t handler, uint8_t arg, uint16_t period, int32_t first);
+void task_remove(int8_t slot);
+void task_set_period(int8_t slot, uint16_t period);
+void task_run(sys_config_t *config);
+void task_print(void);
+
+#endif /* __TASK_H__ */
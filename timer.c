@@ -19,11 +19,24 @@
 #include "project.h"
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 
 #include "timer.h"
 #include "counters.h"
+#include "retune.h"
+#include "events.h"
+#include "isrstat.h"
+
+static void timer_read(uint32_t *ticks, uint16_t *cnt);
+
+#ifdef _RTC_CALIBRATION_
+static uint32_t _g_cal_stamp;
+static uint16_t _g_cal_period;
+static volatile uint32_t _g_cal_cycles; /* CPU cycles in the last window, 0 = none yet */
+#endif /* _RTC_CALIBRATION_ */
 
 void timer_tcb0_init(void)
 {
@@ -34,10 +47,156 @@ void timer_tcb0_init(void)
     TCB0.INTCTRL = _BV(TCB_CAPT_bp);
     //TCB0.CCMP = 20135; // Every 1ms. 20Mhz / 1000 with fudge factor
     TCB0.CCMP = 20000; // Every 1ms. 20Mhz / 1000
+#ifdef _TCB0_LVL1_
+    CPUINT.LVL1VEC = TCB0_INT_vect_num;
+#endif
+}
+
+int32_t timer_get_ticks(void)
+{
+    int32_t ticks;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ticks = _g_counters.tick_count;
+    }
+
+    return ticks;
+}
+
+/*
+ * Microseconds since the timer started, wrapping every ~71 minutes, so
+ * compare times by unsigned subtraction.
+ */
+uint32_t now_us(void)
+{
+    uint32_t ticks;
+    uint16_t cnt;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        timer_read(&ticks, &cnt);
+    }
+
+    return ticks * 1000 + cnt / TIMER_CYCLES_PER_US;
+}
+
+/*
+ * CPU cycles since the timer started, modulo 2^32 (~214 s at 20 MHz).
+ */
+uint32_t now_cycles(void)
+{
+    uint32_t ticks;
+    uint16_t cnt;
+    uint16_t period;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        timer_read(&ticks, &cnt);
+        period = TCB0.CCMP + 1;
+    }
+
+    return ticks * period + cnt;
+}
+
+/*
+ * Reads the tick and CNT as a pair. Interrupts must be off. A CAPT flag
+ * that is still set means CNT has wrapped but the ISR has not yet
+ * counted the tick, so the tick is adjusted and CNT read again to get
+ * its post-wrap value.
+ */
+static void timer_read(uint32_t *ticks, uint16_t *cnt)
+{
+    *ticks = _g_counters.tick_count;
+    *cnt = TCB0.CNT;
+
+    if (TCB0.INTFLAGS & _BV(TCB_CAPT_bp))
+    {
+        (*ticks)++;
+        *cnt = TCB0.CNT;
+    }
 }
 
+uint32_t timed_section_end(timed_section_t *ts)
+{
+    uint32_t elapsed = now_us() - ts->start;
+
+    ts->total += elapsed;
+    ts->count++;
+
+    if (elapsed > ts->max)
+        ts->max = elapsed;
+
+    return elapsed;
+}
+
+#ifdef _RTC_CALIBRATION_
+/*
+ * The RTC overflows once per second of the reference clock. Counting CPU
+ * cycles between overflows gives the real main clock frequency, which
+ * is used to trim TCB0's period so a tick stays 1 ms.
+ */
+void timer_rtc_init(void)
+{
+    while (RTC.STATUS);
+
+    RTC.CLKSEL = RTC_CLKSEL_EXTCLK_gc;
+    RTC.PER = TIMER_CAL_WINDOW - 1;
+    RTC.INTCTRL = RTC_OVF_bm;
+    RTC.CTRLA = RTC_PRESCALER_DIV1_gc | RTC_RTCEN_bm;
+}
+
+bool timer_cal_get(uint32_t *cycles_per_sec, uint16_t *ccmp)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *cycles_per_sec = _g_cal_cycles;
+        *ccmp = TCB0.CCMP;
+    }
+
+    return *cycles_per_sec != 0;
+}
+
+ISR(RTC_CNT_vect)
+{
+    uint32_t ticks;
+    uint16_t cnt;
+    uint32_t stamp;
+
+    ISRSTAT_BEGIN(ISRSTAT_RTC_CNT);
+
+    // TCB0 may be level 1, so keep it out while its count and period are in use
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        timer_read(&ticks, &cnt);
+        stamp = ticks * _g_cal_period + cnt;
+
+        RTC.INTFLAGS = RTC_OVF_bm;
+
+        if (_g_cal_period)
+        {
+            _g_cal_cycles = stamp - _g_cal_stamp;
+            TCB0.CCMP = (_g_cal_cycles + 500) / 1000 - 1;
+        }
+
+        // Take the stamp again against the new period so the next window starts clean
+        _g_cal_period = TCB0.CCMP + 1;
+        timer_read(&ticks, &cnt);
+        _g_cal_stamp = ticks * _g_cal_period + cnt;
+    }
+
+    ISRSTAT_END(ISRSTAT_RTC_CNT);
+}
+#endif /* _RTC_CALIBRATION_ */
+
 ISR(TCB0_INT_vect)
 {
+    ISRSTAT_BEGIN(ISRSTAT_TCB0);
+
     _g_counters.tick_count++;
     TCB0.INTFLAGS = _BV(TCB_CAPT_bp);
+    retune_queue_service(_g_counters.tick_count);
+    event_post(EV_TICK);
+
+    ISRSTAT_END(ISRSTAT_TCB0);
 }
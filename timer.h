@@ -19,6 +19,33 @@
 #ifndef __TIMER_H__
 #define __TIMER_H__
 
+#define TIMER_CYCLES_PER_US     (F_CPU / 1000000UL)
+
+/*
+ * Accumulates the time spent between timed_section_begin() and
+ * timed_section_end(). All times in us.
+ */
+typedef struct
+{
+    uint32_t start;
+    uint32_t total;
+    uint32_t max;
+    uint32_t count;
+} timed_section_t;
+
+#define timed_section_begin(ts)     ((ts)->start = now_us())
+
 void timer_tcb0_init(void);
+int32_t timer_get_ticks(void);
+uint32_t now_us(void);
+uint32_t now_cycles(void);
+uint32_t timed_section_end(timed_section_t *ts);
+
+#ifdef _RTC_CALIBRATION_
+#define TIMER_CAL_WINDOW        32768 /* RTC counts, 1 s */
+
+void timer_rtc_init(void);
+bool timer_cal_get(uint32_t *cycles_per_sec, uint16_t *ccmp);
+#endif /* _RTC_CALIBRATION_ */
 
 #endif /* __TIMER_H__ */
\ No newline at end of file
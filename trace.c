@@ -0,0 +1,134 @@
+/*
+ *   File:   trace.c
+ *   Author: Matt
+ *
+ *   Created on 19 Oct 2026, 09:15
+ *
+ *   Ring of us-stamped events for post-mortem timing analysis, built
+ *   with _TRACE_ only. Events can be added from ISRs. The oldest are
+ *   overwritten once the ring is full.
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#ifdef _TRACE_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "trace.h"
+#include "timer.h"
+#include "util.h"
+
+#define TRACE_MASK              (TRACE_SIZE - 1)
+
+typedef struct
+{
+    uint32_t us;
+    uint8_t event;
+    uint8_t arg;
+} trace_entry_t;
+
+typedef struct
+{
+    trace_entry_t ring[TRACE_SIZE];
+    uint8_t head;       /* Next entry to write */
+    uint8_t count;
+    volatile bool frozen;
+} trace_t;
+
+static const char _g_trace_cmd[] PROGMEM = "cmd";
+static const char _g_trace_solve_start[] PROGMEM = "solve start";
+static const char _g_trace_solve_end[] PROGMEM = "solve end";
+static const char _g_trace_reg_write[] PROGMEM = "reg write";
+static const char _g_trace_le_latch[] PROGMEM = "LE latch";
+static const char _g_trace_ld_edge[] PROGMEM = "LD edge";
+static const char _g_trace_ee_write[] PROGMEM = "EEPROM write";
+static const char _g_trace_ee_done[] PROGMEM = "EEPROM done";
+
+static const char * const _g_trace_names[TRACE_EVENTS] PROGMEM =
+{
+    _g_trace_cmd,
+    _g_trace_solve_start,
+    _g_trace_solve_end,
+    _g_trace_reg_write,
+    _g_trace_le_latch,
+    _g_trace_ld_edge,
+    _g_trace_ee_write,
+    _g_trace_ee_done
+};
+
+static trace_t _g_trace;
+
+void trace_add(uint8_t event, uint8_t arg)
+{
+    trace_entry_t *entry;
+
+    if (_g_trace.frozen)
+        return;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        entry = &_g_trace.ring[_g_trace.head];
+        _g_trace.head = (_g_trace.head + 1) & TRACE_MASK;
+
+        if (_g_trace.count < TRACE_SIZE)
+            _g_trace.count++;
+
+        entry->us = now_us();
+        entry->event = event;
+        entry->arg = arg;
+    }
+}
+
+/*
+ * Oldest first, times relative to the first entry. Tracing is held off
+ * while printing so the dump itself doesn't overwrite the ring.
+ */
+void trace_dump(bool clear)
+{
+    uint8_t idx;
+    uint8_t i;
+    uint32_t base;
+
+    _g_trace.frozen = true;
+
+    idx = (_g_trace.head - _g_trace.count) & TRACE_MASK;
+    base = _g_trace.ring[idx].us;
+
+    printf("\r\nTrace (%u events):\r\n\r\n", _g_trace.count);
+
+    for (i = 0; i < _g_trace.count; i++)
+    {
+        trace_entry_t *entry = &_g_trace.ring[(idx + i) & TRACE_MASK];
+
+        printf("\t+%-10lu %-13S 0x%02X\r\n", entry->us - base,
+            (const char *)pgm_read_ptr(&_g_trace_names[entry->event]), entry->arg);
+    }
+
+    print_p("\r\n");
+
+    if (clear)
+    {
+        _g_trace.head = 0;
+        _g_trace.count = 0;
+    }
+
+    _g_trace.frozen = false;
+}
+
+#endif /* _TRACE_ */
@@ -0,0 +1,50 @@
+/*
+ *   File:   trace.h
+ *   Author: Matt
+ *
+ *   Created on 19 Oct 2026, 09:15
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+/* Events, arg in brackets */
+#define TRACE_CMD               0   /* console, | 0x80 for a binary frame */
+#define TRACE_SOLVE_START       1
+#define TRACE_SOLVE_END         2   /* 1 = solved */
+#define TRACE_REG_WRITE         3   /* register */
+#define TRACE_LE_LATCH          4   /* register */
+#define TRACE_LD_EDGE           5   /* new LD level */
+#define TRACE_EE_WRITE          6   /* start address */
+#define TRACE_EE_DONE           7
+#define TRACE_EVENTS            8
+
+#ifdef _TRACE_
+
+#if (TRACE_SIZE & (TRACE_SIZE - 1)) || TRACE_SIZE > 128
+#error TRACE_SIZE must be a power of 2, at most 128
+#endif
+
+#define TRACE(ev, arg)          trace_add(ev, arg)
+
+void trace_add(uint8_t event, uint8_t arg);
+void trace_dump(bool clear);
+
+#else
+
+#define TRACE(ev, arg)
+
+#endif /* _TRACE_ */
+
+#endif /* __TRACE_H__ */
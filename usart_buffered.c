@@ -25,6 +25,9 @@
 
 #include "usart.h"
 #include "iopins.h"
+#include "events.h"
+#include "isrstat.h"
+#include "counters.h"
 
 #define UART_BUFFER_OVERFLOW  0x02
 
@@ -74,16 +77,24 @@ ISR(USART0_RXC_vect)
     uint8_t data;
     uint8_t usr;
     uint8_t lastRxError;
+
+    ISRSTAT_BEGIN(ISRSTAT_USART0_RXC);
  
     usr  = USART0.RXDATAH;
     data = USART0.RXDATAL;
     
     lastRxError = (usr & (_BV(USART_BUFOVF_bp) | _BV(USART_FERR_bp)));
     tmphead = (_g_usart0_rxhead + 1) & UART_RX_BUFFER_MASK;
+
+    _g_counters.stats.rx_bytes++;
+
+    if (lastRxError)
+        _g_counters.stats.uart_errors++;
     
     if (tmphead == _g_usart0_rxtail)
     {
         lastRxError = UART_BUFFER_OVERFLOW >> 8;
+        _g_counters.stats.uart_errors++;
     }
     else
     {
@@ -91,12 +102,17 @@ ISR(USART0_RXC_vect)
         _g_usart0_rxbuf[tmphead] = data;
     }
 
-    _g_usart0_last_rx_error = lastRxError;   
+    _g_usart0_last_rx_error = lastRxError;
+    event_post(EV_RX);
+
+    ISRSTAT_END(ISRSTAT_USART0_RXC);
 }
 
 ISR(USART0_DRE_vect)
 {
     uint8_t tmptail;
+
+    ISRSTAT_BEGIN(ISRSTAT_USART0_DRE);
     
     if (_g_usart0_txhead != _g_usart0_txtail)
     {
@@ -108,6 +124,8 @@ ISR(USART0_DRE_vect)
     {
         USART0.CTRLA &= ~_BV(USART_DREIE_bp);
     }
+
+    ISRSTAT_END(ISRSTAT_USART0_DRE);
 }
 
 void usart0_open(uint8_t flags, uint16_t brg)
@@ -186,6 +204,7 @@ void usart0_put(char c)
     
     _g_usart0_txbuf[tmphead] = c;
     _g_usart0_txhead = tmphead;
+    _g_counters.stats.tx_bytes++;
 
     USART0.CTRLA |= _BV(USART_DREIE_bp);
 }
@@ -210,16 +229,24 @@ ISR(USART1_RXC_vect)
     uint8_t data;
     uint8_t usr;
     uint8_t lastRxError;
+
+    ISRSTAT_BEGIN(ISRSTAT_USART1_RXC);
  
     usr  = USART1.RXDATAH;
     data = USART1.RXDATAL;
     
     lastRxError = (usr & (_BV(USART_BUFOVF_bp) | _BV(USART_FERR_bp)));
     tmphead = (_g_usart1_rxhead + 1) & UART_RX_BUFFER_MASK;
+
+    _g_counters.stats.rx_bytes++;
+
+    if (lastRxError)
+        _g_counters.stats.uart_errors++;
     
     if (tmphead == _g_usart1_rxtail)
     {
         lastRxError = UART_BUFFER_OVERFLOW >> 8;
+        _g_counters.stats.uart_errors++;
     }
     else
     {
@@ -227,12 +254,17 @@ ISR(USART1_RXC_vect)
         _g_usart1_rxbuf[tmphead] = data;
     }
 
-    _g_usart1_last_rx_error = lastRxError;   
+    _g_usart1_last_rx_error = lastRxError;
+    event_post(EV_RX);
+
+    ISRSTAT_END(ISRSTAT_USART1_RXC);
 }
 
 ISR(USART1_DRE_vect)
 {
     uint8_t tmptail;
+
+    ISRSTAT_BEGIN(ISRSTAT_USART1_DRE);
     
     if (_g_usart1_txhead != _g_usart1_txtail)
     {
@@ -244,6 +276,8 @@ ISR(USART1_DRE_vect)
     {
         USART1.CTRLA &= ~_BV(USART_DREIE_bp);
     }
+
+    ISRSTAT_END(ISRSTAT_USART1_DRE);
 }
 
 void usart1_open(uint8_t flags, uint16_t brg)
@@ -322,6 +356,7 @@ void usart1_put(char c)
     
     _g_usart1_txbuf[tmphead] = c;
     _g_usart1_txhead = tmphead;
+    _g_counters.stats.tx_bytes++;
 
     USART1.CTRLA |= _BV(USART_DREIE_bp);
 }
@@ -28,10 +28,40 @@
 #include <avr/interrupt.h>
 #include <avr/eeprom.h> 
 #include <avr/pgmspace.h>
+#include <util/atomic.h>
 
 #include "util.h"
 #include "usart.h"
 #include "config.h"
+#include "cmd.h"
+#include "events.h"
+#include "counters.h"
+#include "trace.h"
+#include "isrstat.h"
+
+#define EEPROM_JOB_SIZE     EEPROM_SEQ_SIZE /* Largest single write */
+
+#define MEM_PAINT           0xC5
+
+/* Linker symbols */
+extern uint8_t __data_start, __data_end;
+extern uint8_t __bss_start, __bss_end;
+extern uint8_t __heap_start;
+
+typedef struct
+{
+    uint8_t data[EEPROM_JOB_SIZE];
+    uint8_t start;
+    uint8_t addr;   /* Next byte to commit */
+    uint8_t end;
+    volatile bool busy;
+} eeprom_job_t;
+
+static void eeprom_wait(void);
+static void eeprom_job_step(void);
+static void mem_paint(void) __attribute__((naked, used, section(".init1")));
+
+static eeprom_job_t _g_ee_job;
 
 void reset(void)
 {
@@ -43,9 +73,19 @@ void reset(void)
     _PROTECTED_WRITE(RSTCTRL.SWRR, RSTCTRL_SWRE_bm);
 }
 
+/*
+ * Output always goes to the console currently being serviced by cmd.c
+ * (the one which issued the command). Only blocks if the TX ring is full.
+ */
 void putch(char byte)
 {
-    while (console_busy());
+#ifdef _USART1_
+    if (_g_current_console == CONSOLE_2)
+    {
+        console2_put(byte);
+        return;
+    }
+#endif
     console_put(byte);
 }
 
@@ -73,14 +113,231 @@ void format_fixedpoint(char *buf, int16_t value, uint8_t type)
         sprintf(buf, "%s%u.%02u", sign, abs(value) / _2DP_BASE, abs(value) % _2DP_BASE);
 }
 
+static const uint64_t _g_pow10[] PROGMEM =
+{
+    10000000000000000000ULL, 1000000000000000000ULL, 100000000000000000ULL,
+    10000000000000000ULL, 1000000000000000ULL, 100000000000000ULL,
+    10000000000000ULL, 1000000000000ULL, 100000000000ULL, 10000000000ULL,
+    1000000000ULL, 100000000ULL, 10000000ULL, 1000000ULL, 100000ULL,
+    10000ULL, 1000ULL, 100ULL, 10ULL, 1ULL
+};
+
+#define POW10_DIGITS (sizeof(_g_pow10) / sizeof(_g_pow10[0]))
+
+/*
+ * Writes value as a decimal with 'dp' implied decimal places, e.g.
+ * print_u64_dp(2400050000, 6) gives "2400.050000". Digits are produced by
+ * repeated subtraction so no 64-bit division is pulled in.
+ */
+void print_u64_dp(uint64_t value, uint8_t dp)
+{
+    uint8_t i;
+    bool lead = true;
+
+    for (i = 0; i < POW10_DIGITS; i++)
+    {
+        uint64_t pow;
+        char digit = '0';
+
+        memcpy_P(&pow, &_g_pow10[i], sizeof(pow));
+
+        while (value >= pow)
+        {
+            value -= pow;
+            digit++;
+        }
+
+        if (dp && i == POW10_DIGITS - dp)
+            putch('.');
+
+        if (digit != '0' || i >= POW10_DIGITS - 1 - dp)
+            lead = false;
+
+        if (!lead)
+            putch(digit);
+    }
+}
+
+void print_u32(uint32_t value)
+{
+    print_u64_dp(value, 0);
+}
+
+void print_hex32(uint32_t value)
+{
+    uint8_t i;
+
+    for (i = 0; i < 8; i++)
+    {
+        uint8_t nibble = value >> 28;
+        putch(nibble < 10 ? '0' + nibble : 'A' + nibble - 10);
+        value <<= 4;
+    }
+}
+
+void print_pstr(const char *str)
+{
+    char c;
+
+    while ((c = pgm_read_byte(str++)))
+        putch(c);
+}
+
+void print_str(const char *str)
+{
+    while (*str)
+        putch(*str++);
+}
+
+/*
+ * Writes are queued and committed a page at a time from the EEREADY
+ * interrupt, so eeprom_write_data() returns straight away. Bytes which
+ * already hold the right value are not rewritten.
+ */
 void eeprom_write_data(uint8_t addr, uint8_t *bytes, uint8_t len)
 {
-    uint16_t dest = addr;
-    eeprom_update_block(bytes, (void *)dest, len);
+    if (len > sizeof(_g_ee_job.data) || (uint16_t)addr + len > EEPROM_SIZE)
+        reset();
+
+    eeprom_wait();
+
+    memcpy(_g_ee_job.data, bytes, len);
+    _g_ee_job.start = addr;
+    _g_ee_job.addr = addr;
+    _g_ee_job.end = addr + len;
+    _g_ee_job.busy = true;
+
+    TRACE(TRACE_EE_WRITE, addr);
+    NVMCTRL.INTCTRL = NVMCTRL_EEREADY_bm;
 }
 
 void eeprom_read_data(uint8_t addr, uint8_t *bytes, uint8_t len)
 {
     uint16_t dest = addr;
+
+    eeprom_wait();
     eeprom_read_block(bytes, (void *)dest, len);
 }
+
+bool eeprom_write_busy(void)
+{
+    return _g_ee_job.busy;
+}
+
+static void eeprom_wait(void)
+{
+    while (_g_ee_job.busy)
+    {
+        // Nothing will service the job with interrupts off (e.g. at boot), so do it here
+        if (!(SREG & CPU_I_bm) && !(NVMCTRL.STATUS & NVMCTRL_EEBUSY_bm))
+            eeprom_job_step();
+    }
+}
+
+/*
+ * Loads the changed bytes of the next page into the page buffer and
+ * starts an erase/write. Only bytes loaded into the buffer are written.
+ * EEREADY stays set until cleared, so it is cleared once each page is
+ * started, and EEBUSY is checked in case of a stray entry mid-write.
+ */
+static void eeprom_job_step(void)
+{
+    volatile uint8_t *ee = (volatile uint8_t *)MAPPED_EEPROM_START;
+    bool loaded = false;
+
+    if (NVMCTRL.STATUS & NVMCTRL_EEBUSY_bm)
+        return;
+
+    while (_g_ee_job.addr < _g_ee_job.end)
+    {
+        uint8_t value = _g_ee_job.data[_g_ee_job.addr - _g_ee_job.start];
+
+        if (ee[_g_ee_job.addr] != value)
+        {
+            ee[_g_ee_job.addr] = value;
+            loaded = true;
+        }
+
+        _g_ee_job.addr++;
+
+        if (loaded && !(_g_ee_job.addr & (EEPROM_PAGE_SIZE - 1)))
+            break;
+    }
+
+    if (loaded)
+    {
+        _PROTECTED_WRITE_SPM(NVMCTRL.CTRLA, NVMCTRL_CMD_PAGEERASEWRITE_gc);
+        NVMCTRL.INTFLAGS = NVMCTRL_EEREADY_bm;
+        return;
+    }
+
+    NVMCTRL.INTCTRL = 0;
+    _g_ee_job.busy = false;
+    event_post(EV_EEPROM);
+    TRACE(TRACE_EE_DONE, _g_ee_job.start);
+}
+
+ISR(NVMCTRL_EE_vect)
+{
+    ISRSTAT_BEGIN(ISRSTAT_NVM_EE);
+
+    eeprom_job_step();
+
+    ISRSTAT_END(ISRSTAT_NVM_EE);
+}
+
+/*
+ * Copies the statistics block, optionally clearing it in the same
+ * atomic step so nothing counted in between is lost.
+ */
+void stats_read(sys_stats_t *stats, bool reset)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memcpy(stats, &_g_counters.stats, sizeof(sys_stats_t));
+
+        if (reset)
+            memset(&_g_counters.stats, 0, sizeof(sys_stats_t));
+    }
+}
+
+/*
+ * Fills everything above .bss with MEM_PAINT before the C runtime sets
+ * up, so mem_print() can find the deepest the stack has reached. Runs
+ * before r1 is cleared, hence assembly.
+ */
+static void mem_paint(void)
+{
+    __asm__ volatile (
+        "    ldi r30, lo8(__heap_start)\n"
+        "    ldi r31, hi8(__heap_start)\n"
+        "    ldi r24, %0\n"
+        "    ldi r25, hi8(__stack)\n"
+        "    rjmp 2f\n"
+        "1:  st Z+, r24\n"
+        "2:  cpi r30, lo8(__stack)\n"
+        "    cpc r31, r25\n"
+        "    brlo 1b\n"
+        "    breq 1b\n"
+        :: "M" (MEM_PAINT));
+}
+
+/*
+ * Nothing uses malloc(), so the heap is the gap between .bss and the
+ * stack. The high water mark is the lowest byte no longer painted.
+ */
+void mem_print(void)
+{
+    uint8_t *p = &__heap_start;
+    uint8_t *sp = (uint8_t *)SP;
+
+    while (p < sp && *p == MEM_PAINT)
+        p++;
+
+    printf("\r\nSRAM:\r\n\r\n\t.data:        %u\r\n", &__data_end - &__data_start);
+    printf("\t.bss:         %u\r\n", &__bss_end - &__bss_start);
+    printf("\tFree now:     %u\r\n", sp - &__heap_start);
+    printf("\tStack now:    %u\r\n", (uint8_t *)RAMEND - sp);
+    printf("\tStack max:    %u\r\n", (uint8_t *)RAMEND + 1 - p);
+    printf("\tNever used:   %u\r\n\r\n", p - &__heap_start);
+}
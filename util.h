@@ -25,6 +25,7 @@
 #define strcmp_p(str, to) strcmp_P(str, PSTR(to))
 #define strncmp_p(str, to, n) strncmp_P(str, PSTR(to), n)
 #define stricmp(str, to) strcasecmp_P(str, PSTR(to))
+#define print_p(str) print_pstr(PSTR(str))
 
 #define _1DP_BASE 10
 #define _2DP_BASE 100
@@ -59,8 +60,15 @@ void reset(void);
 void format_fixedpoint(char *buf, int16_t value, uint8_t type);
 void eeprom_read_data(uint8_t addr, uint8_t *bytes, uint8_t len);
 void eeprom_write_data(uint8_t addr, uint8_t *bytes, uint8_t len);
+bool eeprom_write_busy(void);
+void mem_print(void);
 char wdt_getch(void);
 void putch(char byte);
+void print_u64_dp(uint64_t value, uint8_t dp);
+void print_u32(uint32_t value);
+void print_hex32(uint32_t value);
+void print_pstr(const char *str);
+void print_str(const char *str);
 int print_char(char byte, FILE *stream);
 
 #endif	/* __UTIL_H__ */